@@ -6,12 +6,14 @@
 
 #include "hd6301.h"
 #include "mem.h"
+#include "event.h"
 
 
 
 #define CASSETTE_SAVE_IDLE_STOP 500000 /* Until save is stopped. */
 #define CASSETTE_INTERNAL_SAMPLE_RATE 612900 /* HX-20 Clock Speed */
 #define CASSETTE_WAV_SAMPLE_RATE 44100
+#define CASSETTE_SAVE_FLUSH 4096 /* Cycles between saving samples. */
 
 
 
@@ -201,16 +203,26 @@ static bool cassette_load_sample(void)
 
 
 
-void cassette_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
+/* Returns the slave clock cycle when the next sample is due. Also called
+   on slave outputs, so P33 has been the same since last time: */
+uint64_t cassette_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
 {
-  static uint16_t sync_catchup = 0;
+  static uint64_t sync_clock = 0;
   static uint32_t save_idle_count;
   static bool save_high_seen = false;
+  static bool save_level = false;
 
-  while (slave_mcu->sync_counter != sync_catchup) {
+  /* Samples are only taken while there is a file, else skip ahead: */
+  if (cassette_save_fh == NULL && cassette_load_fh == NULL) {
+    sync_clock = slave_mcu->clock;
+    save_level = slave_mem->ram[HD6301_REG_PORT_3] & 0x08;
+    return EVENT_NEVER;
+  }
+
+  for (; sync_clock != slave_mcu->clock; sync_clock++) {
     /* Saving */
     if (cassette_save_fh != NULL) {
-      if (slave_mem->ram[HD6301_REG_PORT_3] & 0x08) { /* Port P33 high. */
+      if (save_level) { /* Port P33 high. */
         cassette_save_sample(true);
         save_idle_count = 0;
         save_high_seen = true;
@@ -237,8 +249,15 @@ void cassette_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
         slave_mem->ram[HD6301_REG_PORT_3] &= ~0x04; /* Reset port P32. */
       }
     }
-    sync_catchup++;
   }
+  save_level = slave_mem->ram[HD6301_REG_PORT_3] & 0x08;
+
+  if (cassette_load_fh != NULL) {
+    return slave_mcu->clock + 1; /* P32 input may change each cycle. */
+  } else if (cassette_save_fh != NULL) {
+    return slave_mcu->clock + CASSETTE_SAVE_FLUSH;
+  }
+  return EVENT_NEVER;
 }
 
 
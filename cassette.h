@@ -6,6 +6,6 @@
 
 int cassette_load_file(const char *filename);
 int cassette_save_file(const char *filename);
-void cassette_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
+uint64_t cassette_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
 
 #endif /* _CASSETTE_H */
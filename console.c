@@ -3,7 +3,14 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <string.h>
 #include <curses.h>
+#ifndef CONSOLE_THREAD_DISABLE
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#endif /* CONSOLE_THREAD_DISABLE */
 
 #include "console.h"
 #include "mem.h"
@@ -11,9 +18,18 @@
 
 
 
-#define CONSOLE_SCREEN_UPDATE 10000
-#define CONSOLE_KEYBOARD_UPDATE 20000
-#define CONSOLE_KEYBOARD_RELEASE 500
+/* All in master MCU cycles: */
+#define CONSOLE_SCREEN_UPDATE 40000
+#define CONSOLE_KEYBOARD_UPDATE 80000
+#define CONSOLE_KEYBOARD_RELEASE 2000
+#define CONSOLE_LCD_SERIAL_CYCLES 40000
+
+#define CONSOLE_LCD_WIDTH 120
+#define CONSOLE_LCD_HEIGHT 32
+
+#define CONSOLE_RENDER_HZ 50 /* Host rate of the render thread. */
+#define CONSOLE_KEY_QUEUE_SIZE 16
+#define CONSOLE_FRAME_FRESH 0x4 /* Published and not yet taken. */
 
 #define GATE_A 0
 #define GATE_B 1
@@ -94,6 +110,13 @@ typedef enum {
   SCANCODE_PRINTER      = 0x4F,
 } scancode_t;
 
+typedef struct console_frame_s {
+  uint8_t lcd[CONSOLE_LCD_HEIGHT / 8][CONSOLE_LCD_WIDTH];
+  uint8_t psbuf[4][20];
+  uint8_t cury;
+  uint8_t curx;
+} console_frame_t;
+
 static console_mode_t console_mode = CONSOLE_MODE_NONE;
 static console_charset_t console_charset = CONSOLE_CHARSET_US;
 static bool console_printer_enabled = false;
@@ -112,6 +135,32 @@ static int console_lcd_pixel_row = 0;
 static int console_lcd_clock_tick = 0;
 static int console_lcd_serial_cycles_left = 0;
 
+/* VRAM of all six controllers, eight rows of pixels in each byte: */
+static uint8_t console_lcd_vram[CONSOLE_LCD_HEIGHT / 8][CONSOLE_LCD_WIDTH];
+static bool console_lcd_dirty = false; /* Written since last published. */
+static uint8_t console_lcd_shown[CONSOLE_LCD_HEIGHT / 8][CONSOLE_LCD_WIDTH];
+static uint8_t console_ascii_shown[4][20];
+static int console_ascii_cursor = -1;
+
+#ifndef CONSOLE_THREAD_DISABLE
+/* Triple buffer, the emulation fills one frame while the render thread
+   draws another, and the third holds the latest published frame: */
+static console_frame_t console_frames[3];
+static int console_frame_back = 0;
+static int console_frame_front = 1;
+static atomic_int console_frame_ready = 2;
+static pthread_t console_render_thread;
+static bool console_render_started = false;
+static atomic_bool console_render_stop = false;
+
+/* Keys from the render thread, single producer and single consumer: */
+static int console_key_queue[CONSOLE_KEY_QUEUE_SIZE];
+static atomic_uint console_key_head = 0;
+static atomic_uint console_key_tail = 0;
+#else
+static console_frame_t console_frame;
+#endif /* CONSOLE_THREAD_DISABLE */
+
 
 
 static void console_keyboard_set(scancode_t scancode)
@@ -774,6 +823,236 @@ static void console_keyboard_set_from_char(int ch)
 
 
 
+static bool console_lcd_pixel(int row, int col)
+{
+  if (row < 0 || row >= CONSOLE_LCD_HEIGHT ||
+      col < 0 || col >= CONSOLE_LCD_WIDTH) {
+    return false;
+  }
+  return (console_lcd_vram[row / 8][col] >> (row % 8)) & 1;
+}
+
+
+
+static void console_lcd_pixel_set(int row, int col, bool on)
+{
+  if (row < 0 || row >= CONSOLE_LCD_HEIGHT ||
+      col < 0 || col >= CONSOLE_LCD_WIDTH) {
+    return;
+  }
+  if (on) {
+    console_lcd_vram[row / 8][col] |= (1 << (row % 8));
+  } else {
+    console_lcd_vram[row / 8][col] &= ~(1 << (row % 8));
+  }
+  console_lcd_dirty = true;
+}
+
+
+
+/* Only pixels that differ from what was drawn last are put on the curses
+   screen. Frames may be skipped, so all of it is compared. Returns true if
+   there were any: */
+static bool console_lcd_render(const console_frame_t *frame)
+{
+  bool changed = false;
+  uint8_t diff;
+
+  for (int band = 0; band < CONSOLE_LCD_HEIGHT / 8; band++) {
+    for (int col = 0; col < CONSOLE_LCD_WIDTH; col++) {
+      diff = frame->lcd[band][col] ^ console_lcd_shown[band][col];
+      if (diff == 0) {
+        continue;
+      }
+      for (int i = 0; i < 8; i++) {
+        if ((diff >> i) & 1) {
+          mvaddch((band * 8) + i, col,
+            (frame->lcd[band][col] >> i) & 1 ? '#' : ' ');
+        }
+      }
+      console_lcd_shown[band][col] = frame->lcd[band][col];
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+
+
+/* Same for the characters in "PSBUF" and the cursor at "CURY" and "CURX": */
+static bool console_ascii_render(const console_frame_t *frame)
+{
+  bool changed = false;
+  uint8_t ch;
+
+  for (int row = 0; row < 4; row++) {
+    for (int col = 0; col < 20; col++) {
+      ch = frame->psbuf[row][col];
+      if (! isprint(ch)) {
+        ch = ' ';
+      }
+      if (ch != console_ascii_shown[row][col]) {
+        mvaddch(row, col, ch);
+        console_ascii_shown[row][col] = ch;
+        changed = true;
+      }
+    }
+  }
+
+  if (frame->cury < 4 && frame->curx < 20) {
+    if (changed || console_ascii_cursor != (frame->cury * 20) + frame->curx) {
+      move(frame->cury, frame->curx);
+      console_ascii_cursor = (frame->cury * 20) + frame->curx;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+
+
+static bool console_render(const console_frame_t *frame)
+{
+  if (console_mode == CONSOLE_MODE_CURSES_ASCII) {
+    return console_ascii_render(frame);
+  } else {
+    return console_lcd_render(frame);
+  }
+}
+
+
+
+/* Copy what the renderer needs, returns false if nothing has changed: */
+static bool console_frame_capture(console_frame_t *frame, mem_t *mem)
+{
+  if (console_mode == CONSOLE_MODE_CURSES_ASCII) {
+    memcpy(frame->psbuf, &mem->ram[0x220], sizeof(frame->psbuf));
+    frame->cury = mem->ram[0x279];
+    frame->curx = mem->ram[0x278];
+    return true;
+  }
+
+  if (! console_lcd_dirty) {
+    return false;
+  }
+  memcpy(frame->lcd, console_lcd_vram, sizeof(frame->lcd));
+  console_lcd_dirty = false;
+  return true;
+}
+
+
+
+#ifndef CONSOLE_THREAD_DISABLE
+/* Terminal output and input at a fixed host rate, so a slow terminal does
+   not hold back the emulation: */
+static void *console_render_loop(void *arg)
+{
+  struct timespec interval;
+  unsigned int head;
+  int ch;
+  (void)arg;
+
+  interval.tv_sec = 0;
+  interval.tv_nsec = 1000000000 / CONSOLE_RENDER_HZ;
+
+  while (! atomic_load(&console_render_stop)) {
+    if (atomic_load(&console_frame_ready) & CONSOLE_FRAME_FRESH) {
+      console_frame_front = atomic_exchange(&console_frame_ready,
+        console_frame_front) & ~CONSOLE_FRAME_FRESH;
+      if (console_render(&console_frames[console_frame_front])) {
+        refresh();
+      }
+    }
+
+    while ((ch = getch()) != ERR) {
+      head = atomic_load_explicit(&console_key_head, memory_order_relaxed);
+      if (head - atomic_load_explicit(&console_key_tail,
+        memory_order_acquire) == CONSOLE_KEY_QUEUE_SIZE) {
+        continue; /* Full, the key is lost. */
+      }
+      console_key_queue[head % CONSOLE_KEY_QUEUE_SIZE] = ch;
+      atomic_store_explicit(&console_key_head, head + 1,
+        memory_order_release);
+    }
+
+    nanosleep(&interval, NULL);
+  }
+
+  return NULL;
+}
+
+
+
+static void console_render_start(void)
+{
+  sigset_t set;
+  sigset_t old_set;
+
+  /* Signals are for the main thread only: */
+  sigfillset(&set);
+  pthread_sigmask(SIG_SETMASK, &set, &old_set);
+  atomic_store(&console_render_stop, false);
+  if (pthread_create(&console_render_thread, NULL,
+    console_render_loop, NULL) == 0) {
+    console_render_started = true;
+  }
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+}
+
+
+
+/* Curses is only used by one thread at a time, so wait for it to end: */
+static void console_render_end(void)
+{
+  if (! console_render_started) {
+    return;
+  }
+
+  atomic_store(&console_render_stop, true);
+  pthread_join(console_render_thread, NULL);
+  console_render_started = false;
+}
+
+
+
+static int console_key_get(void)
+{
+  unsigned int tail;
+  int ch;
+
+  tail = atomic_load_explicit(&console_key_tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&console_key_head, memory_order_acquire)) {
+    return ERR;
+  }
+  ch = console_key_queue[tail % CONSOLE_KEY_QUEUE_SIZE];
+  atomic_store_explicit(&console_key_tail, tail + 1, memory_order_release);
+  return ch;
+}
+#endif /* CONSOLE_THREAD_DISABLE */
+
+
+
+/* Serial read of LCD data to get pixel at position: */
+static void console_lcd_serial(mem_t *mem, int cycles)
+{
+  if (console_lcd_serial_cycles_left > 0) {
+    if (console_lcd_clock_tick > 4) {
+      /* Data arrives on the BUSY (a.k.a. SO) pin from the LCD. */
+      if (console_lcd_pixel(console_lcd_row + (12 - console_lcd_clock_tick),
+        console_lcd_col)) {
+        mem->ram[MASTER_IO_KRTN_GATE_B] |= 0x80;
+      } else {
+        mem->ram[MASTER_IO_KRTN_GATE_B] &= ~0x80;
+      }
+    }
+    console_lcd_serial_cycles_left -= cycles;
+  }
+}
+
+
+
 void console_pause(void)
 {
   switch (console_mode) {
@@ -781,6 +1060,9 @@ void console_pause(void)
     break;
   case CONSOLE_MODE_CURSES_ASCII:
   case CONSOLE_MODE_CURSES_PIXEL:
+#ifndef CONSOLE_THREAD_DISABLE
+    console_render_end();
+#endif /* CONSOLE_THREAD_DISABLE */
     endwin();
     timeout(-1);
     break;
@@ -798,6 +1080,9 @@ void console_resume(void)
   case CONSOLE_MODE_CURSES_PIXEL:
     timeout(0);
     refresh();
+#ifndef CONSOLE_THREAD_DISABLE
+    console_render_start();
+#endif /* CONSOLE_THREAD_DISABLE */
     break;
   }
 }
@@ -812,6 +1097,9 @@ void console_exit(void)
 
   case CONSOLE_MODE_CURSES_ASCII:
   case CONSOLE_MODE_CURSES_PIXEL:
+#ifndef CONSOLE_THREAD_DISABLE
+    console_render_end();
+#endif /* CONSOLE_THREAD_DISABLE */
     curs_set(1); /* Reveal cursor. */
     endwin();
     break;
@@ -839,6 +1127,9 @@ int console_init(console_mode_t mode, console_charset_t charset,
     keypad(stdscr, TRUE);
     timeout(0); /* Non-blocking mode. */
     curs_set(0); /* Hide cursor. */
+#ifndef CONSOLE_THREAD_DISABLE
+    console_render_start();
+#endif /* CONSOLE_THREAD_DISABLE */
     break;
 
   default:
@@ -850,14 +1141,18 @@ int console_init(console_mode_t mode, console_charset_t charset,
 
 
 
-void console_execute(hd6301_t *cpu, mem_t *mem)
+void console_execute(hd6301_t *cpu, mem_t *mem, int cycles)
 {
   static int cycle = 0;
-  int row, col;
-  uint16_t address;
+  static int screen_cycle = 0;
+  static int keyboard_cycle = 0;
+#ifdef CONSOLE_THREAD_DISABLE
+  bool changed = false;
+#endif /* CONSOLE_THREAD_DISABLE */
   int ch;
 
   if (console_mode == CONSOLE_MODE_NONE) {
+    console_lcd_serial(mem, cycles);
     return;
   }
 
@@ -920,21 +1215,7 @@ void console_execute(hd6301_t *cpu, mem_t *mem)
     break;
   }
 
-  /* Serial read of LCD data to get pixel at position: */
-  if (console_lcd_serial_cycles_left > 0) {
-    if (console_lcd_clock_tick > 4) {
-      if (console_mode == CONSOLE_MODE_CURSES_PIXEL) {
-        /* Data arrives on the BUSY (a.k.a. SO) pin from the LCD. */
-        if (mvinch(console_lcd_row + (12 - console_lcd_clock_tick),
-          console_lcd_col) == ' ') {
-          mem->ram[MASTER_IO_KRTN_GATE_B] &= ~0x80;
-        } else {
-          mem->ram[MASTER_IO_KRTN_GATE_B] |= 0x80;
-        }
-      }
-    }
-    console_lcd_serial_cycles_left--;
-  }
+  console_lcd_serial(mem, cycles);
 
   /* Release the key after a certain amount of cycles: */
   if (cycle > CONSOLE_KEYBOARD_RELEASE) {
@@ -942,33 +1223,36 @@ void console_execute(hd6301_t *cpu, mem_t *mem)
   }
 
   /* Only refresh screen every X cycle: */
-  cycle++;
-  if ((cycle % CONSOLE_SCREEN_UPDATE) != 0) {
+  if (cycle <= CONSOLE_KEYBOARD_RELEASE) {
+    cycle += cycles;
+  }
+  keyboard_cycle += cycles;
+  screen_cycle += cycles;
+  if (screen_cycle < CONSOLE_SCREEN_UPDATE) {
     return;
   }
+  screen_cycle = 0;
 
-  if (console_mode == CONSOLE_MODE_CURSES_ASCII) {
-    /* Update screen according to "PSBUF": */
-    for (row = 0; row < 4; row++) {
-      for (col = 0; col < 20; col++) {
-        address = 0x220 + (row * 20) + col;
-        if (isprint(mem->ram[address])) {
-          mvaddch(row, col, mem->ram[address]);
-        } else {
-          mvaddch(row, col, ' ');
-        }
-      }
-    }
-
-    /* Move cursor according to "CURY" and "CURX": */
-    if (mem->ram[0x279] < 4 && mem->ram[0x278] < 20) {
-      move(mem->ram[0x279], mem->ram[0x278]);
-    }
+#ifndef CONSOLE_THREAD_DISABLE
+  /* Publish the frame, the render thread takes the latest one: */
+  if (console_frame_capture(&console_frames[console_frame_back], mem)) {
+    console_frame_back = atomic_exchange(&console_frame_ready,
+      console_frame_back | CONSOLE_FRAME_FRESH) & ~CONSOLE_FRAME_FRESH;
   }
+#else
+  if (console_frame_capture(&console_frame, mem)) {
+    changed = console_render(&console_frame);
+  }
+#endif /* CONSOLE_THREAD_DISABLE */
 
   /* Check for keypress, but only every X cycle: */
-  if ((cycle % CONSOLE_KEYBOARD_UPDATE) != 0) {
+  if (keyboard_cycle >= CONSOLE_KEYBOARD_UPDATE) {
+    keyboard_cycle = 0;
+#ifndef CONSOLE_THREAD_DISABLE
+    ch = console_key_get();
+#else
     ch = getch();
+#endif /* CONSOLE_THREAD_DISABLE */
     if (ch != ERR) {
       console_keyboard_clear();
       console_keyboard_set_from_char(ch);
@@ -982,7 +1266,12 @@ void console_execute(hd6301_t *cpu, mem_t *mem)
     }
   }
 
-  refresh();
+#ifdef CONSOLE_THREAD_DISABLE
+  /* Nothing is sent to the terminal if the screen is unchanged: */
+  if (changed) {
+    refresh();
+  }
+#endif /* CONSOLE_THREAD_DISABLE */
 }
 
 
@@ -1067,10 +1356,6 @@ static void console_lcd_update_row_col(uint8_t value)
 
 void console_lcd_data(uint8_t value)
 {
-  if (console_mode != CONSOLE_MODE_CURSES_PIXEL) {
-    return;
-  }
-
   if (console_lcd_command) { /* Command */
     if (value == 0x64) {
       console_lcd_cmd64_seen = true;
@@ -1087,7 +1372,7 @@ void console_lcd_data(uint8_t value)
       } else if (console_lcd_cmd63_seen) {
         /* Request to read from LCD. */
         console_lcd_update_row_col(value);
-        console_lcd_serial_cycles_left = 10000;
+        console_lcd_serial_cycles_left = CONSOLE_LCD_SERIAL_CYCLES;
         console_lcd_clock_tick = 0;
         console_lcd_cmd63_seen = false;
 
@@ -1097,10 +1382,12 @@ void console_lcd_data(uint8_t value)
         if (console_lcd_pixel_col >= 0) {
           if (value >= 0x20 && value <= 0x3C) {
             console_lcd_pixel_row += (value - 0x20) / 4;
-            mvaddch(console_lcd_pixel_row, console_lcd_pixel_col, ' ');
+            console_lcd_pixel_set(console_lcd_pixel_row,
+              console_lcd_pixel_col, false);
           } else if (value >= 0x40 && value <= 0x5C) {
             console_lcd_pixel_row += (value - 0x40) / 4;
-            mvaddch(console_lcd_pixel_row, console_lcd_pixel_col, '%');
+            console_lcd_pixel_set(console_lcd_pixel_row,
+              console_lcd_pixel_col, true);
           }
           console_lcd_pixel_col = -1;
 
@@ -1168,9 +1455,9 @@ void console_lcd_data(uint8_t value)
 
   } else { /* Data */
 
-    for (int i = 0; i < 8; i++) {
-      mvaddch(console_lcd_row + i, console_lcd_col,
-        (value >> i) & 1 ? '#' : ' ');
+    if (console_lcd_col >= 0 && console_lcd_col < CONSOLE_LCD_WIDTH) {
+      console_lcd_vram[console_lcd_row / 8][console_lcd_col] = value;
+      console_lcd_dirty = true;
     }
     console_lcd_col++; /* Automatically incremented for each data package. */
   }
@@ -28,7 +28,7 @@ void console_resume(void);
 void console_exit(void);
 int console_init(console_mode_t mode, console_charset_t charset,
   bool printer_enabled);
-void console_execute(hd6301_t *cpu, mem_t *mem);
+void console_execute(hd6301_t *cpu, mem_t *mem, int cycles);
 
 void console_lcd_select(uint8_t value);
 void console_lcd_data(uint8_t value);
@@ -151,12 +151,10 @@ static void port_dump(FILE *fh, mem_t *mem)
   fprintf(fh, "  RAM.STBY : %d\n", (mem->ram[HD6301_REG_RAM_CTRL] >> 7) & 1);
 
   /* Various */
-  fprintf(fh, "  FRC : 0x%02x%02x\n",
-    mem->ram[HD6301_REG_FRC_HIGH], mem->ram[HD6301_REG_FRC_LOW]);
+  fprintf(fh, "  FRC : 0x%04x\n", ((hd6301_t *)mem->cpu)->counter);
   fprintf(fh, "  OCR : 0x%02x%02x\n",
     mem->ram[HD6301_REG_OCR_HIGH], mem->ram[HD6301_REG_OCR_LOW]);
-  fprintf(fh, "  ICR : 0x%02x%02x\n",
-    mem->ram[HD6301_REG_ICR_HIGH], mem->ram[HD6301_REG_ICR_LOW]);
+  fprintf(fh, "  ICR : 0x%04x\n", ((hd6301_t *)mem->cpu)->icr);
   fprintf(fh, "  RDR : 0x%02x\n", mem->ram[HD6301_REG_RDR]);
   fprintf(fh, "  TDR : 0x%02x\n", mem->ram[HD6301_REG_TDR]);
 }
@@ -217,6 +215,17 @@ static void variable_dump(FILE *fh, mem_t *mem)
 
 
 
+static void trace_enable_notice(void)
+{
+  /* Start tracing from here on, so the next break has something to show. */
+  if (! hd6301_trace_enabled()) {
+    fprintf(stdout, "Trace was off, now turned on.\n");
+    hd6301_trace_enable(true);
+  }
+}
+
+
+
 void debugger_init(void)
 {
   sci_trace_init();
@@ -232,6 +241,7 @@ static void debugger_help(void)
   fprintf(stdout, "  c        - Continue\n");
   fprintf(stdout, "  s        - Step\n");
   fprintf(stdout, "  w        - Warp Mode Toggle\n");
+  fprintf(stdout, "  e        - Trace Toggle\n");
   fprintf(stdout, "  t        - Master MCU Trace\n");
   fprintf(stdout, "  r        - Slave MCU Trace\n");
   fprintf(stdout, "  m        - Master MCU RAM\n");
@@ -312,13 +322,24 @@ bool debugger(hd6301_t *master_mcu, hd6301_t *slave_mcu,
         warp_mode = true;
       }
 
+    } else if (strncmp(argv[0], "e", 1) == 0) {
+      if (hd6301_trace_enabled()) {
+        fprintf(stdout, "Trace: Off\n");
+        hd6301_trace_enable(false);
+      } else {
+        fprintf(stdout, "Trace: On\n");
+        hd6301_trace_enable(true);
+      }
+
     } else if (strncmp(argv[0], "t", 1) == 0) {
       fprintf(stdout, "Master Trace:\n");
       hd6301_trace_dump(stdout, 0);
+      trace_enable_notice();
 
     } else if (strncmp(argv[0], "r", 1) == 0) {
       fprintf(stdout, "Slave Trace:\n");
       hd6301_trace_dump(stdout, 1);
+      trace_enable_notice();
 
     } else if (strncmp(argv[0], "m", 1) == 0) {
       fprintf(stdout, "Master RAM:\n");
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "event.h"
+
+
+
+static void event_swap(event_queue_t *queue, int a, int b)
+{
+  event_id_t id;
+
+  id = queue->heap[a];
+  queue->heap[a] = queue->heap[b];
+  queue->heap[b] = id;
+  queue->index[queue->heap[a]] = a + 1;
+  queue->index[queue->heap[b]] = b + 1;
+}
+
+
+
+static void event_sift_up(event_queue_t *queue, int i)
+{
+  while (i > 0 && queue->time[queue->heap[i]] <
+    queue->time[queue->heap[(i - 1) / 2]]) {
+    event_swap(queue, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+
+
+static void event_sift_down(event_queue_t *queue, int i)
+{
+  int child;
+
+  while ((child = (i * 2) + 1) < queue->size) {
+    if (child + 1 < queue->size && queue->time[queue->heap[child + 1]] <
+      queue->time[queue->heap[child]]) {
+      child++;
+    }
+    if (queue->time[queue->heap[i]] <= queue->time[queue->heap[child]]) {
+      break;
+    }
+    event_swap(queue, i, child);
+    i = child;
+  }
+}
+
+
+
+static void event_remove(event_queue_t *queue, event_id_t id)
+{
+  int i;
+
+  i = queue->index[id] - 1;
+  queue->size--;
+  if (i != queue->size) {
+    event_swap(queue, i, queue->size);
+    event_sift_up(queue, i);
+    event_sift_down(queue, i);
+  }
+  queue->index[id] = 0;
+}
+
+
+
+/* (Re)schedule an event, or remove it if the time is EVENT_NEVER: */
+void event_schedule(event_queue_t *queue, event_id_t id, uint64_t time)
+{
+  if (queue->index[id] > 0) {
+    event_remove(queue, id);
+  }
+  if (time == EVENT_NEVER) {
+    return;
+  }
+
+  queue->time[id] = time;
+  queue->heap[queue->size] = id;
+  queue->size++;
+  queue->index[id] = queue->size;
+  event_sift_up(queue, queue->size - 1);
+}
+
+
+
+uint64_t event_next(event_queue_t *queue)
+{
+  if (queue->size == 0) {
+    return EVENT_NEVER;
+  }
+  return queue->time[queue->heap[0]];
+}
+
+
+
+/* Take the first event due at or before "now", or -1 if there is none: */
+int event_pop(event_queue_t *queue, uint64_t now)
+{
+  event_id_t id;
+
+  if (queue->size == 0 || queue->time[queue->heap[0]] > now) {
+    return -1;
+  }
+
+  id = queue->heap[0];
+  event_remove(queue, id);
+  return id;
+}
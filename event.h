@@ -0,0 +1,33 @@
+#ifndef _EVENT_H
+#define _EVENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_NEVER UINT64_MAX
+
+typedef enum {
+  EVENT_RS232,    /* RS-232 load bit boundary. */
+  EVENT_PRINTER,  /* Printer timing signal pulse. */
+  EVENT_CASSETTE, /* Cassette sample. */
+  EVENT_PIEZO,    /* Piezo FIFO refill. */
+  EVENT_SERIAL,   /* Serial byte slot. */
+  EVENT_SCI_TO_MASTER, /* SCI byte from the slave MCU arrives. */
+  EVENT_SCI_TO_SLAVE,  /* SCI byte from the master MCU arrives. */
+  EVENT_MAX,
+} event_id_t;
+
+/* Binary heap of the peripherals, ordered by the clock cycle they are due.
+   Starts out empty when zeroed: */
+typedef struct event_queue_s {
+  uint64_t time[EVENT_MAX];
+  event_id_t heap[EVENT_MAX];
+  int index[EVENT_MAX]; /* Position in heap plus one, 0 if not scheduled. */
+  int size;
+} event_queue_t;
+
+void event_schedule(event_queue_t *queue, event_id_t id, uint64_t time);
+uint64_t event_next(event_queue_t *queue);
+int event_pop(event_queue_t *queue, uint64_t now);
+
+#endif /* _EVENT_H */
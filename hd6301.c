@@ -2,8 +2,6 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
-#include <stdarg.h>
-#include <string.h>
 
 #include "hd6301.h"
 #include "mem.h"
@@ -12,55 +10,388 @@
 
 
 #define HD6301_TRACE_BUFFER_CPUS 2
+#define HD6301_DECODED_CPUS 2
 #define HD6301_TRACE_BUFFER_SIZE 1024
-#define HD6301_TRACE_BUFFER_ENTRY 80
 
+#define HD6301_JIT_THRESHOLD 64 /* Executions before a block is translated. */
+#define HD6301_JIT_BLOCK_MAX 32 /* Instructions per block. */
+#define HD6301_JIT_POOL_SIZE 0x10000 /* Block instructions per CPU. */
+#define HD6301_JIT_IO_END 0x50 /* Internal registers and master I/O below. */
+#define HD6301_IDLE_LOOP_MAX 16 /* Bytes from loop start to the branch. */
+
+typedef enum {
+  HD6301_MODE_INH,     /* Inherent */
+  HD6301_MODE_IMM8,    /* Immediate (8-bit) */
+  HD6301_MODE_IMM16,   /* Immediate (16-bit) */
+  HD6301_MODE_DIR,     /* Direct */
+  HD6301_MODE_EXT,     /* Extended */
+  HD6301_MODE_IDX,     /* Indexed */
+  HD6301_MODE_REL,     /* Relative */
+  HD6301_MODE_IMM_DIR, /* Immediate and Direct */
+  HD6301_MODE_IMM_IDX, /* Immediate and Indexed */
+} hd6301_mode_t;
+
+typedef struct hd6301_opcode_info_s {
+  const char *mnemonic;
+  hd6301_mode_t mode;
+} hd6301_opcode_info_t;
+
+typedef enum {
+  HD6301_TRACE_UNUSED = 0,
+  HD6301_TRACE_INSTRUCTION,
+  HD6301_TRACE_IRQ_PENDING,
+  HD6301_TRACE_IRQ_IGNORED,
+  HD6301_TRACE_IRQ_EXECUTE,
+} hd6301_trace_type_t;
+
+/* Compact binary record, only formatted into text when dumped. */
+typedef struct hd6301_trace_s {
+  hd6301_trace_type_t type;
+  uint16_t pc;
+  uint16_t d;
+  uint16_t x;
+  uint16_t sp;
+  uint16_t counter;
+  uint8_t ccr;
+  uint8_t opcode;
+  uint8_t operand[2];
+  uint16_t vector_low;
+  uint16_t vector_high;
+} hd6301_trace_t;
+
+/* Loop that the threaded core can skip iterations of, found at its branch: */
+typedef enum {
+  HD6301_IDLE_NONE,
+  HD6301_IDLE_POLL, /* No stores, so repeats until memory is changed. */
+  HD6301_IDLE_DEX,  /* DEX and BNE delay loop. */
+  HD6301_IDLE_DECA, /* DECA and BNE delay loop. */
+  HD6301_IDLE_DECB, /* DECB and BNE delay loop. */
+} hd6301_idle_t;
+
+/* Predecoded instruction, used by the threaded core. */
+typedef struct hd6301_decoded_s {
+  const void *handler; /* Opcode body, entered after the operand fetch. */
+  uint16_t operand;
+  uint16_t address;
+  uint16_t next_pc;
+  uint8_t opcode;
+  bool valid;
+  hd6301_idle_t idle;
+  uint8_t idle_cycles; /* For one iteration of the loop. */
+  uint64_t generation; /* Of the page when decoded, checked for RAM. */
+} hd6301_decoded_t;
+
+/* Run time check needed before a block instruction accesses memory: */
+typedef enum {
+  HD6301_GUARD_NONE,
+  HD6301_GUARD_ADDRESS, /* Indexed address must be outside of I/O. */
+  HD6301_GUARD_STACK,   /* Stack accesses must be outside of I/O. */
+} hd6301_guard_t;
+
+/* Last flag setting operation, evaluated lazily by the threaded core: */
+typedef enum {
+  HD6301_LAZY_NONE,  /* All flags are kept as plain values. */
+  HD6301_LAZY_NZ8,   /* N and Z from 8-bit result, V cleared. */
+  HD6301_LAZY_NZ16,  /* N and Z from 16-bit result, V cleared. */
+  HD6301_LAZY_INC8,  /* N, Z and V from 8-bit increment. */
+  HD6301_LAZY_DEC8,  /* N, Z and V from 8-bit decrement. */
+  HD6301_LAZY_ADD8,  /* H, N, Z, V and C from 8-bit addition. */
+  HD6301_LAZY_SUB8,  /* N, Z, V and C from 8-bit subtraction. */
+  HD6301_LAZY_ADD16, /* N, Z, V and C from 16-bit addition. */
+  HD6301_LAZY_SUB16, /* N, Z, V and C from 16-bit subtraction. */
+} hd6301_lazy_t;
+
+/* Instruction in a translated block, used by the threaded core JIT: */
+typedef struct hd6301_block_op_s {
+  const void *handler; /* Opcode body variant for use inside a block. */
+  uint16_t operand;
+  uint16_t address;
+  uint16_t pc;
+  uint16_t next_pc;
+  uint8_t opcode;
+  hd6301_guard_t guard;
+} hd6301_block_op_t;
+
+/* Execution counter and translated block for a ROM address: */
+typedef struct hd6301_block_s {
+  hd6301_block_op_t *op; /* First instruction, NULL if not translated. */
+  uint16_t length;
+  uint16_t cycles;
+  uint16_t hits;
+  bool failed;
+} hd6301_block_t;
+
+static hd6301_core_t hd6301_core = HD6301_CORE_THREADED;
+static hd6301_decoded_t hd6301_decoded[HD6301_DECODED_CPUS][UINT16_MAX + 1];
+
+static bool hd6301_jit_active = false;
+static hd6301_block_t hd6301_block[HD6301_DECODED_CPUS][UINT16_MAX + 1];
+static hd6301_block_op_t hd6301_block_pool[HD6301_DECODED_CPUS]
+                                          [HD6301_JIT_POOL_SIZE];
+static int hd6301_block_pool_used[HD6301_DECODED_CPUS];
+
+static bool hd6301_trace_active = false;
 static int hd6301_trace_buffer_index[HD6301_TRACE_BUFFER_CPUS];
-static char hd6301_trace_buffer[HD6301_TRACE_BUFFER_CPUS]
-                               [HD6301_TRACE_BUFFER_SIZE]
-                               [HD6301_TRACE_BUFFER_ENTRY];
+static hd6301_trace_t hd6301_trace_buffer[HD6301_TRACE_BUFFER_CPUS]
+                                         [HD6301_TRACE_BUFFER_SIZE];
+
+
+
+static const hd6301_opcode_info_t opcode_info[UINT8_MAX + 1] = {
+  {"trap", HD6301_MODE_INH},     {"nop",  HD6301_MODE_INH},      /* 0x00 */
+  {"???",  HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x02 */
+  {"lsrd", HD6301_MODE_INH},     {"asld", HD6301_MODE_INH},      /* 0x04 */
+  {"tap",  HD6301_MODE_INH},     {"tpa",  HD6301_MODE_INH},      /* 0x06 */
+  {"inx",  HD6301_MODE_INH},     {"dex",  HD6301_MODE_INH},      /* 0x08 */
+  {"clv",  HD6301_MODE_INH},     {"sev",  HD6301_MODE_INH},      /* 0x0A */
+  {"clc",  HD6301_MODE_INH},     {"sec",  HD6301_MODE_INH},      /* 0x0C */
+  {"cli",  HD6301_MODE_INH},     {"sei",  HD6301_MODE_INH},      /* 0x0E */
+  {"sba",  HD6301_MODE_INH},     {"cba",  HD6301_MODE_INH},      /* 0x10 */
+  {"???",  HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x12 */
+  {"???",  HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x14 */
+  {"tab",  HD6301_MODE_INH},     {"tba",  HD6301_MODE_INH},      /* 0x16 */
+  {"xgdx", HD6301_MODE_INH},     {"daa",  HD6301_MODE_INH},      /* 0x18 */
+  {"slp",  HD6301_MODE_INH},     {"aba",  HD6301_MODE_INH},      /* 0x1A */
+  {"???",  HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x1C */
+  {"???",  HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x1E */
+  {"bra",  HD6301_MODE_REL},     {"brn",  HD6301_MODE_REL},      /* 0x20 */
+  {"bhi",  HD6301_MODE_REL},     {"bls",  HD6301_MODE_REL},      /* 0x22 */
+  {"bcc",  HD6301_MODE_REL},     {"bcs",  HD6301_MODE_REL},      /* 0x24 */
+  {"bne",  HD6301_MODE_REL},     {"beq",  HD6301_MODE_REL},      /* 0x26 */
+  {"bvc",  HD6301_MODE_REL},     {"bvs",  HD6301_MODE_REL},      /* 0x28 */
+  {"bpl",  HD6301_MODE_REL},     {"bmi",  HD6301_MODE_REL},      /* 0x2A */
+  {"bge",  HD6301_MODE_REL},     {"blt",  HD6301_MODE_REL},      /* 0x2C */
+  {"bgt",  HD6301_MODE_REL},     {"ble",  HD6301_MODE_REL},      /* 0x2E */
+  {"tsx",  HD6301_MODE_INH},     {"ins",  HD6301_MODE_INH},      /* 0x30 */
+  {"pula", HD6301_MODE_INH},     {"pulb", HD6301_MODE_INH},      /* 0x32 */
+  {"des",  HD6301_MODE_INH},     {"txs",  HD6301_MODE_INH},      /* 0x34 */
+  {"psha", HD6301_MODE_INH},     {"pshb", HD6301_MODE_INH},      /* 0x36 */
+  {"pulx", HD6301_MODE_INH},     {"rts",  HD6301_MODE_INH},      /* 0x38 */
+  {"abx",  HD6301_MODE_INH},     {"rti",  HD6301_MODE_INH},      /* 0x3A */
+  {"pshx", HD6301_MODE_INH},     {"mul",  HD6301_MODE_INH},      /* 0x3C */
+  {"wai",  HD6301_MODE_INH},     {"swi",  HD6301_MODE_INH},      /* 0x3E */
+  {"nega", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x40 */
+  {"???",  HD6301_MODE_INH},     {"coma", HD6301_MODE_INH},      /* 0x42 */
+  {"lsra", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x44 */
+  {"rora", HD6301_MODE_INH},     {"asra", HD6301_MODE_INH},      /* 0x46 */
+  {"asla", HD6301_MODE_INH},     {"rola", HD6301_MODE_INH},      /* 0x48 */
+  {"deca", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x4A */
+  {"inca", HD6301_MODE_INH},     {"tsta", HD6301_MODE_INH},      /* 0x4C */
+  {"???",  HD6301_MODE_INH},     {"clra", HD6301_MODE_INH},      /* 0x4E */
+  {"negb", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x50 */
+  {"???",  HD6301_MODE_INH},     {"comb", HD6301_MODE_INH},      /* 0x52 */
+  {"lsrb", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x54 */
+  {"rorb", HD6301_MODE_INH},     {"asrb", HD6301_MODE_INH},      /* 0x56 */
+  {"aslb", HD6301_MODE_INH},     {"rolb", HD6301_MODE_INH},      /* 0x58 */
+  {"decb", HD6301_MODE_INH},     {"???",  HD6301_MODE_INH},      /* 0x5A */
+  {"incb", HD6301_MODE_INH},     {"tstb", HD6301_MODE_INH},      /* 0x5C */
+  {"???",  HD6301_MODE_INH},     {"clrb", HD6301_MODE_INH},      /* 0x5E */
+  {"neg",  HD6301_MODE_IDX},     {"aim",  HD6301_MODE_IMM_IDX},  /* 0x60 */
+  {"oim",  HD6301_MODE_IMM_IDX}, {"com",  HD6301_MODE_IDX},      /* 0x62 */
+  {"lsr",  HD6301_MODE_IDX},     {"eim",  HD6301_MODE_IMM_IDX},  /* 0x64 */
+  {"ror",  HD6301_MODE_IDX},     {"asr",  HD6301_MODE_IDX},      /* 0x66 */
+  {"asl",  HD6301_MODE_IDX},     {"rol",  HD6301_MODE_IDX},      /* 0x68 */
+  {"dec",  HD6301_MODE_IDX},     {"tim",  HD6301_MODE_IMM_IDX},  /* 0x6A */
+  {"inc",  HD6301_MODE_IDX},     {"tst",  HD6301_MODE_IDX},      /* 0x6C */
+  {"jmp",  HD6301_MODE_IDX},     {"clr",  HD6301_MODE_IDX},      /* 0x6E */
+  {"neg",  HD6301_MODE_EXT},     {"aim",  HD6301_MODE_IMM_DIR},  /* 0x70 */
+  {"oim",  HD6301_MODE_IMM_DIR}, {"com",  HD6301_MODE_EXT},      /* 0x72 */
+  {"lsr",  HD6301_MODE_EXT},     {"eim",  HD6301_MODE_IMM_DIR},  /* 0x74 */
+  {"ror",  HD6301_MODE_EXT},     {"asr",  HD6301_MODE_EXT},      /* 0x76 */
+  {"asl",  HD6301_MODE_EXT},     {"rol",  HD6301_MODE_EXT},      /* 0x78 */
+  {"dec",  HD6301_MODE_EXT},     {"tim",  HD6301_MODE_IMM_DIR},  /* 0x7A */
+  {"inc",  HD6301_MODE_EXT},     {"tst",  HD6301_MODE_EXT},      /* 0x7C */
+  {"jmp",  HD6301_MODE_EXT},     {"clr",  HD6301_MODE_EXT},      /* 0x7E */
+  {"suba", HD6301_MODE_IMM8},    {"cmpa", HD6301_MODE_IMM8},     /* 0x80 */
+  {"sbca", HD6301_MODE_IMM8},    {"subd", HD6301_MODE_IMM16},    /* 0x82 */
+  {"anda", HD6301_MODE_IMM8},    {"bita", HD6301_MODE_IMM8},     /* 0x84 */
+  {"ldaa", HD6301_MODE_IMM8},    {"???",  HD6301_MODE_INH},      /* 0x86 */
+  {"eora", HD6301_MODE_IMM8},    {"adca", HD6301_MODE_IMM8},     /* 0x88 */
+  {"oraa", HD6301_MODE_IMM8},    {"adda", HD6301_MODE_IMM8},     /* 0x8A */
+  {"cpx",  HD6301_MODE_IMM16},   {"bsr",  HD6301_MODE_REL},      /* 0x8C */
+  {"lds",  HD6301_MODE_IMM16},   {"???",  HD6301_MODE_INH},      /* 0x8E */
+  {"suba", HD6301_MODE_DIR},     {"cmpa", HD6301_MODE_DIR},      /* 0x90 */
+  {"sbca", HD6301_MODE_DIR},     {"subd", HD6301_MODE_DIR},      /* 0x92 */
+  {"anda", HD6301_MODE_DIR},     {"bita", HD6301_MODE_DIR},      /* 0x94 */
+  {"ldaa", HD6301_MODE_DIR},     {"staa", HD6301_MODE_DIR},      /* 0x96 */
+  {"eora", HD6301_MODE_DIR},     {"adca", HD6301_MODE_DIR},      /* 0x98 */
+  {"oraa", HD6301_MODE_DIR},     {"adda", HD6301_MODE_DIR},      /* 0x9A */
+  {"cpx",  HD6301_MODE_DIR},     {"jsr",  HD6301_MODE_DIR},      /* 0x9C */
+  {"lds",  HD6301_MODE_DIR},     {"sts",  HD6301_MODE_DIR},      /* 0x9E */
+  {"suba", HD6301_MODE_IDX},     {"cmpa", HD6301_MODE_IDX},      /* 0xA0 */
+  {"sbca", HD6301_MODE_IDX},     {"subd", HD6301_MODE_IDX},      /* 0xA2 */
+  {"anda", HD6301_MODE_IDX},     {"bita", HD6301_MODE_IDX},      /* 0xA4 */
+  {"ldaa", HD6301_MODE_IDX},     {"staa", HD6301_MODE_IDX},      /* 0xA6 */
+  {"eora", HD6301_MODE_IDX},     {"adca", HD6301_MODE_IDX},      /* 0xA8 */
+  {"oraa", HD6301_MODE_IDX},     {"adda", HD6301_MODE_IDX},      /* 0xAA */
+  {"cpx",  HD6301_MODE_IDX},     {"jsr",  HD6301_MODE_IDX},      /* 0xAC */
+  {"lds",  HD6301_MODE_IDX},     {"sts",  HD6301_MODE_IDX},      /* 0xAE */
+  {"suba", HD6301_MODE_EXT},     {"cmpa", HD6301_MODE_EXT},      /* 0xB0 */
+  {"sbca", HD6301_MODE_EXT},     {"subd", HD6301_MODE_EXT},      /* 0xB2 */
+  {"anda", HD6301_MODE_EXT},     {"bita", HD6301_MODE_EXT},      /* 0xB4 */
+  {"ldaa", HD6301_MODE_EXT},     {"staa", HD6301_MODE_EXT},      /* 0xB6 */
+  {"eora", HD6301_MODE_EXT},     {"adca", HD6301_MODE_EXT},      /* 0xB8 */
+  {"oraa", HD6301_MODE_EXT},     {"adda", HD6301_MODE_EXT},      /* 0xBA */
+  {"cpx",  HD6301_MODE_EXT},     {"jsr",  HD6301_MODE_EXT},      /* 0xBC */
+  {"lds",  HD6301_MODE_EXT},     {"sts",  HD6301_MODE_EXT},      /* 0xBE */
+  {"subb", HD6301_MODE_IMM8},    {"cmpb", HD6301_MODE_IMM8},     /* 0xC0 */
+  {"sbcb", HD6301_MODE_IMM8},    {"addd", HD6301_MODE_IMM16},    /* 0xC2 */
+  {"andb", HD6301_MODE_IMM8},    {"bitb", HD6301_MODE_IMM8},     /* 0xC4 */
+  {"ldab", HD6301_MODE_IMM8},    {"???",  HD6301_MODE_INH},      /* 0xC6 */
+  {"eorb", HD6301_MODE_IMM8},    {"adcb", HD6301_MODE_IMM8},     /* 0xC8 */
+  {"orab", HD6301_MODE_IMM8},    {"addb", HD6301_MODE_IMM8},     /* 0xCA */
+  {"ldd",  HD6301_MODE_IMM16},   {"???",  HD6301_MODE_INH},      /* 0xCC */
+  {"ldx",  HD6301_MODE_IMM16},   {"???",  HD6301_MODE_INH},      /* 0xCE */
+  {"subb", HD6301_MODE_DIR},     {"cmpb", HD6301_MODE_DIR},      /* 0xD0 */
+  {"sbcb", HD6301_MODE_DIR},     {"addd", HD6301_MODE_DIR},      /* 0xD2 */
+  {"andb", HD6301_MODE_DIR},     {"bitb", HD6301_MODE_DIR},      /* 0xD4 */
+  {"ldab", HD6301_MODE_DIR},     {"stab", HD6301_MODE_DIR},      /* 0xD6 */
+  {"eorb", HD6301_MODE_DIR},     {"adcb", HD6301_MODE_DIR},      /* 0xD8 */
+  {"orab", HD6301_MODE_DIR},     {"addb", HD6301_MODE_DIR},      /* 0xDA */
+  {"ldd",  HD6301_MODE_DIR},     {"std",  HD6301_MODE_DIR},      /* 0xDC */
+  {"ldx",  HD6301_MODE_DIR},     {"stx",  HD6301_MODE_DIR},      /* 0xDE */
+  {"subb", HD6301_MODE_IDX},     {"cmpb", HD6301_MODE_IDX},      /* 0xE0 */
+  {"sbcb", HD6301_MODE_IDX},     {"addd", HD6301_MODE_IDX},      /* 0xE2 */
+  {"andb", HD6301_MODE_IDX},     {"bitb", HD6301_MODE_IDX},      /* 0xE4 */
+  {"ldab", HD6301_MODE_IDX},     {"stab", HD6301_MODE_IDX},      /* 0xE6 */
+  {"eorb", HD6301_MODE_IDX},     {"adcb", HD6301_MODE_IDX},      /* 0xE8 */
+  {"orab", HD6301_MODE_IDX},     {"addb", HD6301_MODE_IDX},      /* 0xEA */
+  {"ldd",  HD6301_MODE_IDX},     {"std",  HD6301_MODE_IDX},      /* 0xEC */
+  {"ldx",  HD6301_MODE_IDX},     {"stx",  HD6301_MODE_IDX},      /* 0xEE */
+  {"subb", HD6301_MODE_EXT},     {"cmpb", HD6301_MODE_EXT},      /* 0xF0 */
+  {"sbcb", HD6301_MODE_EXT},     {"addd", HD6301_MODE_EXT},      /* 0xF2 */
+  {"andb", HD6301_MODE_EXT},     {"bitb", HD6301_MODE_EXT},      /* 0xF4 */
+  {"ldab", HD6301_MODE_EXT},     {"stab", HD6301_MODE_EXT},      /* 0xF6 */
+  {"eorb", HD6301_MODE_EXT},     {"adcb", HD6301_MODE_EXT},      /* 0xF8 */
+  {"orab", HD6301_MODE_EXT},     {"addb", HD6301_MODE_EXT},      /* 0xFA */
+  {"ldd",  HD6301_MODE_EXT},     {"std",  HD6301_MODE_EXT},      /* 0xFC */
+  {"ldx",  HD6301_MODE_EXT},     {"stx",  HD6301_MODE_EXT},      /* 0xFE */
+};
+
+
+
+static hd6301_trace_t *hd6301_trace_next(hd6301_t *cpu)
+{
+  hd6301_trace_t *trace;
+
+  trace = &hd6301_trace_buffer[cpu->id][hd6301_trace_buffer_index[cpu->id]];
+  hd6301_trace_buffer_index[cpu->id]++;
+  if (hd6301_trace_buffer_index[cpu->id] >= HD6301_TRACE_BUFFER_SIZE) {
+    hd6301_trace_buffer_index[cpu->id] = 0;
+  }
+  return trace;
+}
 
 
 
-static void hd6301_trace(hd6301_t *cpu, const char *op_name, 
-  const char *format, ...)
+static void hd6301_trace(hd6301_t *cpu, mem_t *mem, uint8_t opcode)
 {
-  va_list args;
-  char buffer[HD6301_TRACE_BUFFER_ENTRY + 2];
-  int n = 0;
+  hd6301_trace_t *trace;
 
-  if (op_name != NULL) { /* Regular CPU instruction trace. */
-    n += snprintf(&buffer[n], HD6301_TRACE_BUFFER_ENTRY - n,
-      "PC=%04x A:B=%04x X=%04x SP=%04x CCR=%02x(11%c%c%c%c%c%c) [%d] ",
-      cpu->pc - 1, cpu->d, cpu->x, cpu->sp, cpu->ccr,
-      cpu->h ? 'H' : 'h',
-      cpu->i ? 'I' : 'i',
-      cpu->n ? 'N' : 'n',
-      cpu->z ? 'Z' : 'z',
-      cpu->v ? 'V' : 'v',
-      cpu->c ? 'C' : 'c',
-      cpu->counter);
+  trace = hd6301_trace_next(cpu);
+  trace->type    = HD6301_TRACE_INSTRUCTION;
+  trace->pc      = cpu->pc - 1;
+  trace->d       = cpu->d;
+  trace->x       = cpu->x;
+  trace->sp      = cpu->sp;
+  trace->counter = cpu->counter;
+  trace->ccr     = cpu->ccr;
+  trace->opcode  = opcode;
 
-    n += snprintf(&buffer[n], HD6301_TRACE_BUFFER_ENTRY - n, "%s ", op_name);
+  /* Peek directly, since a traced mem_read() may have side effects. */
+  trace->operand[0] = mem->ram[(uint16_t)(cpu->pc)];
+  trace->operand[1] = mem->ram[(uint16_t)(cpu->pc + 1)];
+}
 
-  } else { /* Special message trace. */
-    n += snprintf(&buffer[n], HD6301_TRACE_BUFFER_ENTRY - n,
-      "PC=%04x ", cpu->pc - 1);
-  }
 
-  if (format != NULL) {
-    va_start(args, format);
-    n += vsnprintf(&buffer[n], HD6301_TRACE_BUFFER_ENTRY - n, format, args);
-    va_end(args);
+
+static void hd6301_trace_irq(hd6301_t *cpu, hd6301_trace_type_t type,
+  uint16_t vector_low, uint16_t vector_high)
+{
+  hd6301_trace_t *trace;
+
+  if (! hd6301_trace_active) {
+    return;
   }
 
-  n += snprintf(&buffer[n], HD6301_TRACE_BUFFER_ENTRY - n, "\n");
+  trace = hd6301_trace_next(cpu);
+  trace->type        = type;
+  trace->pc          = cpu->pc - 1;
+  trace->vector_low  = vector_low;
+  trace->vector_high = vector_high;
+}
+
+
+
+static void hd6301_trace_print(FILE *fh, hd6301_trace_t *trace)
+{
+  switch (trace->type) {
+  case HD6301_TRACE_INSTRUCTION:
+    fprintf(fh,
+      "PC=%04x A:B=%04x X=%04x SP=%04x CCR=%02x(11%c%c%c%c%c%c) [%d] %s ",
+      trace->pc, trace->d, trace->x, trace->sp, trace->ccr,
+      (trace->ccr >> 5) & 1 ? 'H' : 'h',
+      (trace->ccr >> 4) & 1 ? 'I' : 'i',
+      (trace->ccr >> 3) & 1 ? 'N' : 'n',
+      (trace->ccr >> 2) & 1 ? 'Z' : 'z',
+      (trace->ccr >> 1) & 1 ? 'V' : 'v',
+       trace->ccr       & 1 ? 'C' : 'c',
+      trace->counter,
+      opcode_info[trace->opcode].mnemonic);
+
+    switch (opcode_info[trace->opcode].mode) {
+    case HD6301_MODE_IMM8:
+      fprintf(fh, "#%02x", trace->operand[0]);
+      break;
+    case HD6301_MODE_IMM16:
+      fprintf(fh, "#%02x%02x", trace->operand[0], trace->operand[1]);
+      break;
+    case HD6301_MODE_DIR:
+    case HD6301_MODE_REL:
+      fprintf(fh, "%02x", trace->operand[0]);
+      break;
+    case HD6301_MODE_EXT:
+      fprintf(fh, "%02x%02x", trace->operand[0], trace->operand[1]);
+      break;
+    case HD6301_MODE_IDX:
+      fprintf(fh, "%02x,x", trace->operand[0]);
+      break;
+    case HD6301_MODE_IMM_DIR:
+      fprintf(fh, "#%02x, %02x", trace->operand[0], trace->operand[1]);
+      break;
+    case HD6301_MODE_IMM_IDX:
+      fprintf(fh, "#%02x, %02x,x", trace->operand[0], trace->operand[1]);
+      break;
+    case HD6301_MODE_INH:
+    default:
+      /* Show the opcode itself for TRAP (0x00) and undefined ones: */
+      if (trace->opcode == 0x00 ||
+          opcode_info[trace->opcode].mnemonic[0] == '?') {
+        fprintf(fh, "%02x", trace->opcode);
+      }
+      break;
+    }
+    fprintf(fh, "\n");
+    break;
+
+  case HD6301_TRACE_IRQ_PENDING:
+    fprintf(fh, "PC=%04x IRQ pending %04x:%04x\n",
+      trace->pc, trace->vector_low, trace->vector_high);
+    break;
 
-  strncpy(hd6301_trace_buffer[cpu->id][hd6301_trace_buffer_index[cpu->id]],
-    buffer, HD6301_TRACE_BUFFER_ENTRY);
-  hd6301_trace_buffer_index[cpu->id]++;
-  if (hd6301_trace_buffer_index[cpu->id] >= HD6301_TRACE_BUFFER_SIZE) {
-    hd6301_trace_buffer_index[cpu->id] = 0;
+  case HD6301_TRACE_IRQ_IGNORED:
+    fprintf(fh, "PC=%04x IRQ ignored %04x:%04x\n",
+      trace->pc, trace->vector_low, trace->vector_high);
+    break;
+
+  case HD6301_TRACE_IRQ_EXECUTE:
+    fprintf(fh, "PC=%04x IRQ execute %04x:%04x\n",
+      trace->pc, trace->vector_low, trace->vector_high);
+    break;
+
+  case HD6301_TRACE_UNUSED:
+  default:
+    break;
   }
 }
 
@@ -70,7 +401,7 @@ void hd6301_trace_init(void)
 {
   for (int i = 0; i < HD6301_TRACE_BUFFER_CPUS; i++) {
     for (int j = 0; j < HD6301_TRACE_BUFFER_SIZE; j++) {
-      hd6301_trace_buffer[i][j][0] = '\0';
+      hd6301_trace_buffer[i][j].type = HD6301_TRACE_UNUSED;
     }
     hd6301_trace_buffer_index[i] = 0;
   }
@@ -82,14 +413,10 @@ void hd6301_trace_dump(FILE *fh, int cpu_id)
 {
   for (int i = hd6301_trace_buffer_index[cpu_id];
            i < HD6301_TRACE_BUFFER_SIZE; i++) {
-    if (hd6301_trace_buffer[cpu_id][i][0] != '\0') {
-      fprintf(fh, hd6301_trace_buffer[cpu_id][i]);
-    }
+    hd6301_trace_print(fh, &hd6301_trace_buffer[cpu_id][i]);
   }
   for (int i = 0; i < hd6301_trace_buffer_index[cpu_id]; i++) {
-    if (hd6301_trace_buffer[cpu_id][i][0] != '\0') {
-      fprintf(fh, hd6301_trace_buffer[cpu_id][i]);
-    }
+    hd6301_trace_print(fh, &hd6301_trace_buffer[cpu_id][i]);
   }
 }
 
@@ -99,8 +426,10 @@ void hd6301_dump(FILE *fh, hd6301_t *cpu)
 {
   fprintf(fh, "CPU #%d\n", cpu->id);
   fprintf(fh, "  Sleep         : %d\n", cpu->sleep);
+  fprintf(fh, "  Wait          : %d\n", cpu->wait);
   fprintf(fh, "  Counter       : %d\n", cpu->counter);
-  fprintf(fh, "  Sync Counter  : %d\n", cpu->sync_counter);
+  fprintf(fh, "  Clock         : %llu\n", (unsigned long long)cpu->clock);
+  fprintf(fh, "  Idle Skipped  : %lu\n", cpu->idle_skipped);
   fprintf(fh, "  Shift Register: %d (0x%02x)\n",
     cpu->transmit_shift_register, cpu->transmit_shift_register);
   fprintf(fh, "  IRQ Pending   : %d\n", cpu->irq_pending);
@@ -110,3142 +439,1775 @@ void hd6301_dump(FILE *fh, hd6301_t *cpu)
 
 
 
-static void op_aba(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  uint8_t prev_a;
-  uint8_t prev_b;
-  hd6301_trace(cpu, "aba", NULL);
-  prev_a = cpu->a;
-  prev_b = cpu->b;
-  cpu->a += cpu->b;
-  cpu->h = (((prev_a & prev_b) | (prev_b & ~cpu->a) | (~cpu->a & prev_a)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev_a & prev_b & ~cpu->a) | (~prev_a & ~prev_b & cpu->a)) >> 7;
-  cpu->c = ((prev_a & prev_b) | (prev_b & ~cpu->a) | (~cpu->a & prev_a)) >> 7;
-}
+static const int opcode_cycles[UINT8_MAX + 1] = {
+/*
+  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+*/
+  0, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x00 -> 0x0F */
+  1, 1, 0, 0, 0, 0, 1, 1, 2, 2, 4, 1, 0, 0, 0, 0, /* 0x10 -> 0x1F */
+  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 0x20 -> 0x2F */
+  1, 1, 3, 3, 1, 1, 4, 4, 4, 5, 1,10, 5, 7, 9,12, /* 0x30 -> 0x3F */
+  1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, /* 0x40 -> 0x4F */
+  1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, /* 0x50 -> 0x5F */
+  6, 7, 7, 6, 6, 7, 6, 6, 6, 6, 6, 5, 6, 4, 3, 5, /* 0x60 -> 0x6F */
+  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 4, 6, 4, 3, 5, /* 0x70 -> 0x7F */
+  2, 2, 2, 3, 2, 2, 2, 0, 2, 2, 2, 2, 3, 5, 3, 0, /* 0x80 -> 0x8F */
+  3, 3, 3, 4, 3, 3, 3, 3, 3, 3, 3, 3, 4, 5, 4, 4, /* 0x90 -> 0x9F */
+  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xA0 -> 0xAF */
+  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 6, 5, 5, /* 0xB0 -> 0xBF */
+  2, 2, 2, 3, 2, 2, 2, 0, 2, 2, 2, 2, 3, 0, 3, 0, /* 0xC0 -> 0xCF */
+  3, 3, 3, 4, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, /* 0xD0 -> 0xDF */
+  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xE0 -> 0xEF */
+  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xF0 -> 0xFF */
+};
 
-static void op_abx(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "abx", NULL);
-  cpu->x += cpu->b;
-}
 
-static void op_adca_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adca", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->a += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
 
-static void op_adca_ext(hd6301_t *cpu, mem_t *mem)
+static void hd6301_counter_increment(hd6301_t *cpu, mem_t *mem, int cycles)
 {
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adca", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->a += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
+  uint16_t prev_counter;
 
-static void op_adca_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adca", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->a += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
+  cpu->clock += cycles;
 
-static void op_adca_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "adca", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->a += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
+  prev_counter = cpu->counter;
+  cpu->counter += cycles;
 
-static void op_adcb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adcb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->b += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
+  /* Output compare, if the match is within the cycles just run: */
+  if ((uint16_t)(cpu->timer_event - prev_counter) < cycles) {
+    mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_OCF);
+    /* Generate IRQ if enabled: */
+    if ((mem->ram[HD6301_REG_TCSR] >> HD6301_TCSR_EOCI) & 1) {
+      hd6301_irq(cpu, mem, HD6301_VECTOR_OCF_LOW, HD6301_VECTOR_OCF_HIGH);
+    }
 
-static void op_adcb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adcb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->b += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
+    /* Set P21 based on OLVL as used by RS232C: */
+    if (mem->ram[HD6301_REG_TCSR] & 1) {
+      mem->ram[HD6301_REG_PORT_2] |= 0x02;
+    } else {
+      mem->ram[HD6301_REG_PORT_2] &= ~0x02;
+    }
+    cpu->p21_set = true;
+    cpu->sync_event = true;
+  }
 }
 
-static void op_adcb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adcb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->b += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
 
-static void op_adcb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "adcb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->b += cpu->c;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
 
-static void op_adda_dir(hd6301_t *cpu, mem_t *mem)
+/* Only called when one of the writes flagged in cpu->pending happened: */
+static void hd6301_housekeeping(hd6301_t *cpu, mem_t *mem)
 {
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adda", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
+  /* RDRF clear: */
+  if (cpu->pending & HD6301_PENDING_RDRF_CLEAR) {
+    mem->ram[HD6301_REG_TRCSR] &= ~(1 << HD6301_TRCSR_RDRF);
+  }
 
-static void op_adda_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adda", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
+  /* Check for P20 input change and possibly ICR transfer: */
+  if ((cpu->pending & HD6301_PENDING_P20) &&
+    (mem->ram[HD6301_REG_PORT_2] & 1) != cpu->p20_prev) {
+    if ((mem->ram[HD6301_REG_TCSR] >> HD6301_TCSR_IEDG) & 1) {
+      /* Low to High transition. */
+      if (cpu->p20_prev == false) {
+        cpu->icr = cpu->counter;
+        mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_ICF);
+      }
+    } else {
+      /* High to Low transition. */
+      if (cpu->p20_prev == true) {
+        cpu->icr = cpu->counter;
+        mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_ICF);
+      }
+    }
+    cpu->p20_prev = mem->ram[HD6301_REG_PORT_2] & 1;
+  }
 
-static void op_adda_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "adda", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
+  cpu->pending &= ~HD6301_PENDING_HOUSEKEEPING;
 }
 
-static void op_adda_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "adda", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->a;
-  cpu->a += value;
-  cpu->h = (((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 3) & 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->a) | (~prev & ~value & cpu->a)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->a) | (~cpu->a & prev)) >> 7;
-}
 
-static void op_addb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
 
-static void op_addb_ext(hd6301_t *cpu, mem_t *mem)
+/* Pester CPU with SCI IRQ while there are still unread RDR contents. The
+   flag only means that it may be due, so drop it once found not to be: */
+static bool hd6301_sci_irq_due(hd6301_t *cpu, mem_t *mem)
 {
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
+  if ((cpu->pending & HD6301_PENDING_SCI_IRQ) == 0) {
+    return false;
+  }
+  if (((mem->ram[HD6301_REG_TRCSR] >> HD6301_TRCSR_RDRF) &
+    (mem->ram[HD6301_REG_TRCSR] >> HD6301_TRCSR_RIE)) & 1) {
+    return true;
+  }
+  cpu->pending &= ~HD6301_PENDING_SCI_IRQ;
+  return false;
 }
 
-static void op_addb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
 
-static void op_addb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "addb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->b;
-  cpu->b += value;
-  cpu->h = (((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 3) & 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->b) | (~prev & ~value & cpu->b)) >> 7;
-  cpu->c = ((prev & value) | (value & ~cpu->b) | (~cpu->b & prev)) >> 7;
-}
 
-static void op_addd_dir(hd6301_t *cpu, mem_t *mem)
+/* Cycles up to and including the next OCR match. Right after a match that
+   is a full counter period, which is kept below one so it still moves: */
+static int hd6301_ocr_cycles(hd6301_t *cpu)
 {
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addd", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d += value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->d) | (~prev & ~value & cpu->d)) >> 15;
-  cpu->c = ((prev & value) | (value & ~cpu->d) | (~cpu->d & prev)) >> 15;
-}
+  int ocr_cycles;
 
-static void op_addd_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addd", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d += value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->d) | (~prev & ~value & cpu->d)) >> 15;
-  cpu->c = ((prev & value) | (value & ~cpu->d) | (~cpu->d & prev)) >> 15;
+  ocr_cycles = (uint16_t)(cpu->timer_event - cpu->counter) + 1;
+  return (ocr_cycles > UINT16_MAX) ? UINT16_MAX : ocr_cycles;
 }
 
-static void op_addd_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "addd", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d += value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->d) | (~prev & ~value & cpu->d)) >> 15;
-  cpu->c = ((prev & value) | (value & ~cpu->d) | (~cpu->d & prev)) >> 15;
-}
 
-static void op_addd_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  hd6301_trace(cpu, "addb", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++) * 0x100;
-  value += mem_read(mem, cpu->pc++);
-  prev = cpu->d;
-  cpu->d += value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = ((prev & value & ~cpu->d) | (~prev & ~value & cpu->d)) >> 15;
-  cpu->c = ((prev & value) | (value & ~cpu->d) | (~cpu->d & prev)) >> 15;
-}
 
-static void op_aim_dir(hd6301_t *cpu, mem_t *mem)
+/* Nothing wakes a sleeping or waiting CPU from the inside before the OCR
+   match, so the cycles up to and including it can be run at once: */
+static int hd6301_sleep_cycles(hd6301_t *cpu, int cycles)
 {
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "aim", "#%02x, %02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++);
-  value &= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  int ocr_cycles;
 
-static void op_aim_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "aim", "#%02x, %02x,x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value &= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
+  ocr_cycles = hd6301_ocr_cycles(cpu);
+  return (ocr_cycles < cycles) ? ocr_cycles : cycles;
 }
 
-static void op_anda_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "anda", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a &= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
 
-static void op_anda_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "anda", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a &= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
 
-static void op_anda_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "anda", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->a &= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+/* Instruction bodies, shared by both cores. Registers are kept in locals and
+   only spilled when needed: */
+#ifdef __GNUC__
+#define HD6301_THREADED_GOTO /* Computed goto, otherwise switch fallback. */
+#endif
 
-static void op_anda_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "anda", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->a &= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+/* Operand fetch for each addressing mode: */
+#define HD6301_FETCH_INH
+#define HD6301_FETCH_IMM8 \
+  operand = mem_read(mem, pc++);
+#define HD6301_FETCH_IMM16 \
+  operand = mem_read(mem, pc++) * 0x100; \
+  operand += mem_read(mem, pc++);
+#define HD6301_FETCH_DIR \
+  address = mem_read(mem, pc++);
+#define HD6301_FETCH_EXT \
+  address = mem_read(mem, pc++) * 0x100; \
+  address += mem_read(mem, pc++);
+#define HD6301_FETCH_IDX \
+  address = mem_read(mem, pc++);
+#define HD6301_FETCH_REL \
+  operand = mem_read(mem, pc++);
+#define HD6301_FETCH_IMM_DIR \
+  operand = mem_read(mem, pc++); \
+  address = mem_read(mem, pc++);
+#define HD6301_FETCH_IMM_IDX \
+  operand = mem_read(mem, pc++); \
+  address = mem_read(mem, pc++);
 
-static void op_andb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "andb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b &= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+/* Effective address, separate from fetch since it depends on X: */
+#define HD6301_EA_INH
+#define HD6301_EA_IMM8
+#define HD6301_EA_IMM16
+#define HD6301_EA_DIR
+#define HD6301_EA_EXT
+#define HD6301_EA_IDX     address += x;
+#define HD6301_EA_REL
+#define HD6301_EA_IMM_DIR
+#define HD6301_EA_IMM_IDX address += x;
 
-static void op_andb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "andb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b &= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+/* Operand values: */
+#define HD6301_LOAD8(mode) HD6301_LOAD8_##mode
+#define HD6301_LOAD8_IMM8 ((uint8_t)operand)
+#define HD6301_LOAD8_DIR  mem_read(mem, address)
+#define HD6301_LOAD8_EXT  mem_read(mem, address)
+#define HD6301_LOAD8_IDX  mem_read(mem, address)
 
-static void op_andb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "andb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->b &= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+#define HD6301_LOAD16(mode, value) HD6301_LOAD16_##mode(value)
+#define HD6301_LOAD16_IMM16(value) \
+  value = operand;
+#define HD6301_LOAD16_MEM(value) \
+  value = mem_read(mem, address) * 0x100; \
+  value += mem_read(mem, address + 1);
+#define HD6301_LOAD16_DIR(value) HD6301_LOAD16_MEM(value)
+#define HD6301_LOAD16_EXT(value) HD6301_LOAD16_MEM(value)
+#define HD6301_LOAD16_IDX(value) HD6301_LOAD16_MEM(value)
+
+/* Read-modify-write target, either an accumulator or memory: */
+#define HD6301_RMW_READ(r, mode) HD6301_RMW_READ_##mode(r)
+#define HD6301_RMW_READ_INH(r) value = r;
+#define HD6301_RMW_READ_EXT(r) value = mem_read(mem, address);
+#define HD6301_RMW_READ_IDX(r) value = mem_read(mem, address);
+
+#define HD6301_RMW_WRITE(r, mode) HD6301_RMW_WRITE_##mode(r)
+#define HD6301_RMW_WRITE_INH(r) r = value;
+#define HD6301_RMW_WRITE_EXT(r) mem_write(mem, address, value);
+#define HD6301_RMW_WRITE_IDX(r) mem_write(mem, address, value);
+
+/* Flags are computed from the last operation when needed, like by branches.
+   Kinds that don't cover a flag fall back to its plain value: */
+#define HD6301_CARRY(x, y, r, bit) \
+  ((((x) & (y)) | ((y) & ~(r)) | (~(r) & (x))) >> (bit) & 1)
+#define HD6301_BORROW(x, y, r, bit) \
+  (((~(x) & (y)) | ((y) & (r)) | ((r) & ~(x))) >> (bit) & 1)
+#define HD6301_ADD_OVERFLOW(x, y, r, bit) \
+  ((((x) & (y) & ~(r)) | (~(x) & ~(y) & (r))) >> (bit) & 1)
+#define HD6301_SUB_OVERFLOW(x, y, r, bit) \
+  ((((x) & ~(y) & ~(r)) | (~(x) & (y) & (r))) >> (bit) & 1)
+
+#define HD6301_FLAG_H \
+  (lazy_op == HD6301_LAZY_ADD8 ? \
+    HD6301_CARRY(lazy_x, lazy_y, lazy_r, 3) : h)
+#define HD6301_FLAG_N \
+  (lazy_op == HD6301_LAZY_NONE ? n : \
+   (lazy_op == HD6301_LAZY_NZ16 || lazy_op >= HD6301_LAZY_ADD16) ? \
+    (lazy_r >> 15) & 1 : (lazy_r >> 7) & 1)
+#define HD6301_FLAG_Z \
+  (lazy_op == HD6301_LAZY_NONE ? z : lazy_r == 0)
+#define HD6301_FLAG_V \
+  (lazy_op == HD6301_LAZY_NONE ? v : \
+   lazy_op <= HD6301_LAZY_NZ16 ? 0 : \
+   lazy_op == HD6301_LAZY_INC8 ? lazy_r == 0x80 : \
+   lazy_op == HD6301_LAZY_DEC8 ? lazy_r == 0x7f : \
+   lazy_op == HD6301_LAZY_ADD8 ? \
+    HD6301_ADD_OVERFLOW(lazy_x, lazy_y, lazy_r, 7) : \
+   lazy_op == HD6301_LAZY_SUB8 ? \
+    HD6301_SUB_OVERFLOW(lazy_x, lazy_y, lazy_r, 7) : \
+   lazy_op == HD6301_LAZY_ADD16 ? \
+    HD6301_ADD_OVERFLOW(lazy_x, lazy_y, lazy_r, 15) : \
+    HD6301_SUB_OVERFLOW(lazy_x, lazy_y, lazy_r, 15))
+#define HD6301_FLAG_C \
+  (lazy_op < HD6301_LAZY_ADD8 ? c : \
+   lazy_op == HD6301_LAZY_ADD8 ? HD6301_CARRY(lazy_x, lazy_y, lazy_r, 7) : \
+   lazy_op == HD6301_LAZY_SUB8 ? HD6301_BORROW(lazy_x, lazy_y, lazy_r, 7) : \
+   lazy_op == HD6301_LAZY_ADD16 ? HD6301_CARRY(lazy_x, lazy_y, lazy_r, 15) : \
+    HD6301_BORROW(lazy_x, lazy_y, lazy_r, 15))
+
+/* Record a lazy operation, first keeping flags it does not cover: */
+#define HD6301_LAZY(kind, x, y, r) \
+  if (lazy_op == HD6301_LAZY_ADD8 && (kind) != HD6301_LAZY_ADD8) { \
+    h = HD6301_FLAG_H; \
+  } \
+  if ((kind) < HD6301_LAZY_ADD8) { \
+    c = HD6301_FLAG_C; \
+  } \
+  lazy_x = (x); \
+  lazy_y = (y); \
+  lazy_r = (r); \
+  lazy_op = (kind);
+
+/* Turn all flags into plain values, before setting only some of them: */
+#define HD6301_FLAGS() \
+  if (lazy_op != HD6301_LAZY_NONE) { \
+    h = HD6301_FLAG_H; \
+    n = HD6301_FLAG_N; \
+    z = HD6301_FLAG_Z; \
+    v = HD6301_FLAG_V; \
+    c = HD6301_FLAG_C; \
+    lazy_op = HD6301_LAZY_NONE; \
+  }
 
-static void op_andb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "andb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->b &= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+#define HD6301_D ((uint16_t)((a * 0x100) + b))
+#define HD6301_CCR \
+  ((u << 6) + (HD6301_FLAG_H << 5) + (i << 4) + (HD6301_FLAG_N << 3) + \
+   (HD6301_FLAG_Z << 2) + (HD6301_FLAG_V << 1) + HD6301_FLAG_C)
+
+/* Spills are frequent in the table core, so the whole CCR is put together
+   by a function there instead of expanding all the flags in place: */
+static uint8_t hd6301_ccr(uint8_t u, uint8_t h, uint8_t i, uint8_t n,
+  uint8_t z, uint8_t v, uint8_t c, hd6301_lazy_t lazy_op,
+  uint16_t lazy_x, uint16_t lazy_y, uint16_t lazy_r)
+{
+  return HD6301_CCR;
+}
+
+#define HD6301_SET_D(value) \
+  a = (value) / 0x100; \
+  b = (value) % 0x100;
+#define HD6301_SET_CCR(value) \
+  c = (value) & 1; \
+  v = ((value) >> 1) & 1; \
+  z = ((value) >> 2) & 1; \
+  n = ((value) >> 3) & 1; \
+  i = ((value) >> 4) & 1; \
+  h = ((value) >> 5) & 1; \
+  u = ((value) >> 6) & 3; \
+  lazy_op = HD6301_LAZY_NONE;
+
+#define HD6301_SPILL() \
+  cpu->a = a; \
+  cpu->b = b; \
+  cpu->x = x; \
+  cpu->sp = sp; \
+  cpu->pc = pc; \
+  cpu->ccr = hd6301_ccr(u, h, i, n, z, v, c, \
+    lazy_op, lazy_x, lazy_y, lazy_r);
+#define HD6301_RELOAD() \
+  a = cpu->a; \
+  b = cpu->b; \
+  x = cpu->x; \
+  sp = cpu->sp; \
+  pc = cpu->pc; \
+  HD6301_SET_CCR(cpu->ccr)
+
+/* Calls that may take an IRQ, and thereby use or change the registers: */
+#define HD6301_IRQ(vector_low, vector_high) \
+  clock_start = cpu->clock; \
+  HD6301_SPILL() \
+  hd6301_irq(cpu, mem, vector_low, vector_high); \
+  HD6301_RELOAD() \
+  elapsed += cpu->clock - clock_start;
+#define HD6301_COUNTER_INCREMENT(cycles) \
+  clock_start = cpu->clock; \
+  HD6301_SPILL() \
+  hd6301_counter_increment(cpu, mem, cycles); \
+  HD6301_RELOAD() \
+  elapsed += cpu->clock - clock_start;
+
+#define HD6301_BRANCH(condition) \
+  if (condition) { \
+    pc += (int8_t)operand; \
+  }
 
-static void op_asl_ext(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "asl", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  carry = (value & 0x80) >> 7;
-  value <<= 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+#define HD6301_PUSH16(value) \
+  mem_write(mem, sp--, (value) % 0x100); \
+  mem_write(mem, sp--, (value) / 0x100);
+#define HD6301_PULL16(value) \
+  value = mem_read(mem, ++sp) * 0x100; \
+  value += mem_read(mem, ++sp);
+
+#define HD6301_NZ8(value) \
+  n = ((value) & 0x80) >> 7; \
+  z = (value) == 0 ? 1 : 0;
+#define HD6301_NZ16(value) \
+  n = ((value) & 0x8000) >> 15; \
+  z = (value) == 0 ? 1 : 0;
+
+/* Operations, the first argument is a register operand if any: */
+#define HD6301_OP_none(r, mode) \
+  panic("Panic! Unhandled opcode: 0x%02x @ %04x\n", \
+    mem_read(mem, pc - 1), pc - 1);
+
+#define HD6301_OP_trap(r, mode) \
+  HD6301_IRQ(HD6301_VECTOR_TRAP_LOW, HD6301_VECTOR_TRAP_HIGH)
+
+#define HD6301_OP_nop(r, mode)
+
+#define HD6301_OP_lsrd(r, mode) { \
+  bool carry; \
+  HD6301_FLAGS() \
+  uint16_t d = HD6301_D; \
+  carry = d & 1; \
+  d >>= 1; \
+  HD6301_SET_D(d) \
+  n = 0; \
+  z = d == 0 ? 1 : 0; \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_asld(r, mode) { \
+  bool carry; \
+  HD6301_FLAGS() \
+  uint16_t d = HD6301_D; \
+  carry = (d & 0x8000) >> 15; \
+  d <<= 1; \
+  HD6301_SET_D(d) \
+  HD6301_NZ16(d) \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_tap(r, mode) HD6301_SET_CCR(a)
+#define HD6301_OP_tpa(r, mode) a = HD6301_CCR;
+
+#define HD6301_OP_inx(r, mode) \
+  HD6301_FLAGS() \
+  x++; \
+  z = x == 0 ? 1 : 0;
+#define HD6301_OP_dex(r, mode) \
+  HD6301_FLAGS() \
+  x--; \
+  z = x == 0 ? 1 : 0;
+
+#define HD6301_OP_clv(r, mode) HD6301_FLAGS() v = 0;
+#define HD6301_OP_sev(r, mode) HD6301_FLAGS() v = 1;
+#define HD6301_OP_clc(r, mode) HD6301_FLAGS() c = 0;
+#define HD6301_OP_sec(r, mode) HD6301_FLAGS() c = 1;
+#define HD6301_OP_cli(r, mode) i = 0;
+#define HD6301_OP_sei(r, mode) i = 1;
+
+#define HD6301_OP_sba(r, mode) { \
+  uint8_t prev = a; \
+  a = a - b; \
+  HD6301_LAZY(HD6301_LAZY_SUB8, prev, b, a) }
+
+#define HD6301_OP_cba(r, mode) { \
+  uint8_t result = a - b; \
+  HD6301_LAZY(HD6301_LAZY_SUB8, a, b, result) }
+
+#define HD6301_OP_tab(r, mode) \
+  b = a; \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, b)
+#define HD6301_OP_tba(r, mode) \
+  a = b; \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, a)
+
+#define HD6301_OP_xgdx(r, mode) { \
+  uint16_t temp = HD6301_D; \
+  HD6301_SET_D(x) \
+  x = temp; }
+
+#define HD6301_OP_daa(r, mode) panic("DAA not implemented!\n");
+#define HD6301_OP_wai(r, mode) \
+  HD6301_PUSH16(pc) \
+  HD6301_PUSH16(x) \
+  mem_write(mem, sp--, a); \
+  mem_write(mem, sp--, b); \
+  mem_write(mem, sp--, HD6301_CCR); \
+  cpu->wait = true;
+#define HD6301_OP_swi(r, mode) panic("SWI not implemented!\n");
+#define HD6301_OP_slp(r, mode) cpu->sleep = true;
+
+#define HD6301_OP_aba(r, mode) { \
+  uint8_t prev = a; \
+  a += b; \
+  HD6301_LAZY(HD6301_LAZY_ADD8, prev, b, a) }
+
+#define HD6301_OP_bra(r, mode) HD6301_BRANCH(1)
+#define HD6301_OP_brn(r, mode) HD6301_BRANCH(0)
+#define HD6301_OP_bhi(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_C + HD6301_FLAG_Z) == 0)
+#define HD6301_OP_bls(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_C + HD6301_FLAG_Z) == 1)
+#define HD6301_OP_bcc(r, mode) HD6301_BRANCH(HD6301_FLAG_C == 0)
+#define HD6301_OP_bcs(r, mode) HD6301_BRANCH(HD6301_FLAG_C == 1)
+#define HD6301_OP_bne(r, mode) HD6301_BRANCH(HD6301_FLAG_Z == 0)
+#define HD6301_OP_beq(r, mode) HD6301_BRANCH(HD6301_FLAG_Z == 1)
+#define HD6301_OP_bvc(r, mode) HD6301_BRANCH(HD6301_FLAG_V == 0)
+#define HD6301_OP_bvs(r, mode) HD6301_BRANCH(HD6301_FLAG_V == 1)
+#define HD6301_OP_bpl(r, mode) HD6301_BRANCH(HD6301_FLAG_N == 0)
+#define HD6301_OP_bmi(r, mode) HD6301_BRANCH(HD6301_FLAG_N == 1)
+#define HD6301_OP_bge(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_N ^ HD6301_FLAG_V) == 0)
+#define HD6301_OP_blt(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_N ^ HD6301_FLAG_V) == 1)
+#define HD6301_OP_bgt(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_Z + (HD6301_FLAG_N ^ HD6301_FLAG_V)) == 0)
+#define HD6301_OP_ble(r, mode) \
+  HD6301_BRANCH((HD6301_FLAG_Z + (HD6301_FLAG_N ^ HD6301_FLAG_V)) == 1)
+
+#define HD6301_OP_bsr(r, mode) \
+  HD6301_PUSH16(pc) \
+  pc += (int8_t)operand;
+
+#define HD6301_OP_tsx(r, mode)  x = sp + 1;
+#define HD6301_OP_ins(r, mode)  sp++;
+#define HD6301_OP_des(r, mode)  sp--;
+#define HD6301_OP_txs(r, mode)  sp = x - 1;
+#define HD6301_OP_abx(r, mode)  x += b;
+#define HD6301_OP_pula(r, mode) a = mem_read(mem, ++sp);
+#define HD6301_OP_pulb(r, mode) b = mem_read(mem, ++sp);
+#define HD6301_OP_psha(r, mode) mem_write(mem, sp--, a);
+#define HD6301_OP_pshb(r, mode) mem_write(mem, sp--, b);
+#define HD6301_OP_pulx(r, mode) HD6301_PULL16(x)
+#define HD6301_OP_pshx(r, mode) HD6301_PUSH16(x)
+#define HD6301_OP_rts(r, mode)  HD6301_PULL16(pc)
+
+#define HD6301_OP_rti(r, mode) { \
+  uint8_t ccr = mem_read(mem, ++sp); \
+  HD6301_SET_CCR(ccr) \
+  b = mem_read(mem, ++sp); \
+  a = mem_read(mem, ++sp); \
+  HD6301_PULL16(x) \
+  HD6301_PULL16(pc) }
+
+#define HD6301_OP_mul(r, mode) { \
+  uint16_t result = a * b; \
+  HD6301_FLAGS() \
+  a = result / 0x100; \
+  b = result % 0x100; \
+  c = (b & 0x80) >> 7; }
+
+#define HD6301_OP_neg(r, mode) { \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  value = (value == 0x80 ? 0x80 : -value); \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = value == 0x80 ? 1 : 0; \
+  c = value == 0 ? 0 : 1; }
+
+#define HD6301_OP_com(r, mode) { \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  value = ~value; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = 0; \
+  c = 1; }
+
+#define HD6301_OP_lsr(r, mode) { \
+  bool carry; \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  carry = value & 1; \
+  value >>= 1; \
+  HD6301_RMW_WRITE(r, mode) \
+  n = 0; \
+  z = value == 0 ? 1 : 0; \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_ror(r, mode) { \
+  bool carry; \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  carry = value & 1; \
+  value >>= 1; \
+  value |= (c << 7); \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_asr(r, mode) { \
+  bool carry; \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  carry = value & 1; \
+  value = (value >> 1) | (value & 0x80); \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_asl(r, mode) { \
+  bool carry; \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  carry = (value & 0x80) >> 7; \
+  value <<= 1; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_rol(r, mode) { \
+  bool carry; \
+  uint8_t value; \
+  HD6301_FLAGS() \
+  HD6301_RMW_READ(r, mode) \
+  carry = (value & 0x80) >> 7; \
+  value <<= 1; \
+  value |= c; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_NZ8(value) \
+  v = n ^ carry; \
+  c = carry; }
+
+#define HD6301_OP_dec(r, mode) { \
+  uint8_t value; \
+  HD6301_RMW_READ(r, mode) \
+  value -= 1; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_LAZY(HD6301_LAZY_DEC8, 0, 0, value) }
+
+#define HD6301_OP_inc(r, mode) { \
+  uint8_t value; \
+  HD6301_RMW_READ(r, mode) \
+  value += 1; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_LAZY(HD6301_LAZY_INC8, 0, 0, value) }
+
+#define HD6301_OP_tst(r, mode) { \
+  uint8_t value; \
+  HD6301_RMW_READ(r, mode) \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, value) \
+  c = 0; }
+
+#define HD6301_OP_clr(r, mode) { \
+  uint8_t value = 0; \
+  HD6301_RMW_WRITE(r, mode) \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, 0) \
+  c = 0; }
+
+#define HD6301_OP_aim(r, mode) { \
+  uint8_t value = operand; \
+  value &= mem_read(mem, address); \
+  mem_write(mem, address, value); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, value) }
+#define HD6301_OP_oim(r, mode) { \
+  uint8_t value = operand; \
+  value |= mem_read(mem, address); \
+  mem_write(mem, address, value); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, value) }
+#define HD6301_OP_eim(r, mode) { \
+  uint8_t value = operand; \
+  value ^= mem_read(mem, address); \
+  mem_write(mem, address, value); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, value) }
+#define HD6301_OP_tim(r, mode) { \
+  uint8_t value = operand; \
+  value &= mem_read(mem, address); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, value) }
+
+#define HD6301_OP_jmp(r, mode) pc = address;
+#define HD6301_OP_jsr(r, mode) \
+  HD6301_PUSH16(pc) \
+  pc = address;
+
+#define HD6301_OP_add(r, mode) { \
+  uint8_t value = HD6301_LOAD8(mode); \
+  uint8_t prev = r; \
+  r += value; \
+  HD6301_LAZY(HD6301_LAZY_ADD8, prev, value, r) }
+
+#define HD6301_OP_adc(r, mode) { \
+  uint8_t value = HD6301_LOAD8(mode); \
+  uint8_t prev = r; \
+  r += value; \
+  r += HD6301_FLAG_C; \
+  HD6301_LAZY(HD6301_LAZY_ADD8, prev, value, r) }
+
+#define HD6301_OP_sub(r, mode) { \
+  uint8_t value = HD6301_LOAD8(mode); \
+  uint8_t prev = r; \
+  r -= value; \
+  HD6301_LAZY(HD6301_LAZY_SUB8, prev, value, r) }
+
+#define HD6301_OP_sbc(r, mode) { \
+  uint8_t value = HD6301_LOAD8(mode); \
+  uint8_t prev = r; \
+  r -= value; \
+  r -= HD6301_FLAG_C; \
+  HD6301_LAZY(HD6301_LAZY_SUB8, prev, value, r) }
+
+#define HD6301_OP_cmp(r, mode) { \
+  uint8_t value = HD6301_LOAD8(mode); \
+  uint8_t result = r - value; \
+  HD6301_LAZY(HD6301_LAZY_SUB8, r, value, result) }
+
+#define HD6301_OP_bit(r, mode) { \
+  uint8_t result = r & HD6301_LOAD8(mode); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, result) }
+
+#define HD6301_OP_and(r, mode) \
+  r &= HD6301_LOAD8(mode); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, r)
+#define HD6301_OP_ora(r, mode) \
+  r |= HD6301_LOAD8(mode); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, r)
+#define HD6301_OP_eor(r, mode) \
+  r ^= HD6301_LOAD8(mode); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, r)
+#define HD6301_OP_ld(r, mode) \
+  r = HD6301_LOAD8(mode); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, r)
+#define HD6301_OP_st(r, mode) \
+  mem_write(mem, address, r); \
+  HD6301_LAZY(HD6301_LAZY_NZ8, 0, 0, r)
+
+#define HD6301_OP_addd(r, mode) { \
+  uint16_t value; \
+  uint16_t prev = HD6301_D; \
+  uint16_t d; \
+  HD6301_LOAD16(mode, value) \
+  d = prev + value; \
+  HD6301_SET_D(d) \
+  HD6301_LAZY(HD6301_LAZY_ADD16, prev, value, d) }
+
+#define HD6301_OP_subd(r, mode) { \
+  uint16_t value; \
+  uint16_t prev = HD6301_D; \
+  uint16_t d; \
+  HD6301_FLAGS() \
+  HD6301_LOAD16(mode, value) \
+  d = prev - value; \
+  HD6301_SET_D(d) \
+  HD6301_NZ16(d) \
+  v = (prev & ~value & ~d & ~prev & value & d) >> 15; \
+  c = ((~prev & value) | (value & d) | (d & ~prev)) >> 15; }
+
+#define HD6301_OP_cpx(r, mode) { \
+  uint16_t value; \
+  uint16_t result; \
+  HD6301_LOAD16(mode, value) \
+  result = x - value; \
+  HD6301_LAZY(HD6301_LAZY_SUB16, x, value, result) }
+
+#define HD6301_OP_ldd(r, mode) { \
+  uint16_t value; \
+  HD6301_LOAD16(mode, value) \
+  HD6301_SET_D(value) \
+  HD6301_LAZY(HD6301_LAZY_NZ16, 0, 0, value) }
+
+#define HD6301_OP_std(r, mode) \
+  mem_write(mem, address, a); \
+  mem_write(mem, address + 1, b); \
+  HD6301_LAZY(HD6301_LAZY_NZ16, 0, 0, HD6301_D)
+
+#define HD6301_OP_ld16(r, mode) \
+  HD6301_LOAD16(mode, r) \
+  HD6301_LAZY(HD6301_LAZY_NZ16, 0, 0, r)
+
+#define HD6301_OP_st16(r, mode) \
+  mem_write(mem, address, r / 0x100); \
+  mem_write(mem, address + 1, r % 0x100); \
+  HD6301_LAZY(HD6301_LAZY_NZ16, 0, 0, r)
+
+#define HD6301_OPCODE_SPEC(X) \
+  X(0x00, INH,       trap,  _)    X(0x01, INH,       nop,   _)   \
+  X(0x02, INH,       none,  _)    X(0x03, INH,       none,  _)   \
+  X(0x04, INH,       lsrd,  _)    X(0x05, INH,       asld,  _)   \
+  X(0x06, INH,       tap,   _)    X(0x07, INH,       tpa,   _)   \
+  X(0x08, INH,       inx,   _)    X(0x09, INH,       dex,   _)   \
+  X(0x0A, INH,       clv,   _)    X(0x0B, INH,       sev,   _)   \
+  X(0x0C, INH,       clc,   _)    X(0x0D, INH,       sec,   _)   \
+  X(0x0E, INH,       cli,   _)    X(0x0F, INH,       sei,   _)   \
+  X(0x10, INH,       sba,   _)    X(0x11, INH,       cba,   _)   \
+  X(0x12, INH,       none,  _)    X(0x13, INH,       none,  _)   \
+  X(0x14, INH,       none,  _)    X(0x15, INH,       none,  _)   \
+  X(0x16, INH,       tab,   _)    X(0x17, INH,       tba,   _)   \
+  X(0x18, INH,       xgdx,  _)    X(0x19, INH,       daa,   _)   \
+  X(0x1A, INH,       slp,   _)    X(0x1B, INH,       aba,   _)   \
+  X(0x1C, INH,       none,  _)    X(0x1D, INH,       none,  _)   \
+  X(0x1E, INH,       none,  _)    X(0x1F, INH,       none,  _)   \
+  X(0x20, REL,       bra,   _)    X(0x21, REL,       brn,   _)   \
+  X(0x22, REL,       bhi,   _)    X(0x23, REL,       bls,   _)   \
+  X(0x24, REL,       bcc,   _)    X(0x25, REL,       bcs,   _)   \
+  X(0x26, REL,       bne,   _)    X(0x27, REL,       beq,   _)   \
+  X(0x28, REL,       bvc,   _)    X(0x29, REL,       bvs,   _)   \
+  X(0x2A, REL,       bpl,   _)    X(0x2B, REL,       bmi,   _)   \
+  X(0x2C, REL,       bge,   _)    X(0x2D, REL,       blt,   _)   \
+  X(0x2E, REL,       bgt,   _)    X(0x2F, REL,       ble,   _)   \
+  X(0x30, INH,       tsx,   _)    X(0x31, INH,       ins,   _)   \
+  X(0x32, INH,       pula,  _)    X(0x33, INH,       pulb,  _)   \
+  X(0x34, INH,       des,   _)    X(0x35, INH,       txs,   _)   \
+  X(0x36, INH,       psha,  _)    X(0x37, INH,       pshb,  _)   \
+  X(0x38, INH,       pulx,  _)    X(0x39, INH,       rts,   _)   \
+  X(0x3A, INH,       abx,   _)    X(0x3B, INH,       rti,   _)   \
+  X(0x3C, INH,       pshx,  _)    X(0x3D, INH,       mul,   _)   \
+  X(0x3E, INH,       wai,   _)    X(0x3F, INH,       swi,   _)   \
+  X(0x40, INH,       neg,   a)    X(0x41, INH,       none,  _)   \
+  X(0x42, INH,       none,  _)    X(0x43, INH,       com,   a)   \
+  X(0x44, INH,       lsr,   a)    X(0x45, INH,       none,  _)   \
+  X(0x46, INH,       ror,   a)    X(0x47, INH,       asr,   a)   \
+  X(0x48, INH,       asl,   a)    X(0x49, INH,       rol,   a)   \
+  X(0x4A, INH,       dec,   a)    X(0x4B, INH,       none,  _)   \
+  X(0x4C, INH,       inc,   a)    X(0x4D, INH,       tst,   a)   \
+  X(0x4E, INH,       none,  _)    X(0x4F, INH,       clr,   a)   \
+  X(0x50, INH,       neg,   b)    X(0x51, INH,       none,  _)   \
+  X(0x52, INH,       none,  _)    X(0x53, INH,       com,   b)   \
+  X(0x54, INH,       lsr,   b)    X(0x55, INH,       none,  _)   \
+  X(0x56, INH,       ror,   b)    X(0x57, INH,       asr,   b)   \
+  X(0x58, INH,       asl,   b)    X(0x59, INH,       rol,   b)   \
+  X(0x5A, INH,       dec,   b)    X(0x5B, INH,       none,  _)   \
+  X(0x5C, INH,       inc,   b)    X(0x5D, INH,       tst,   b)   \
+  X(0x5E, INH,       none,  _)    X(0x5F, INH,       clr,   b)   \
+  X(0x60, IDX,       neg,   _)    X(0x61, IMM_IDX,   aim,   _)   \
+  X(0x62, IMM_IDX,   oim,   _)    X(0x63, IDX,       com,   _)   \
+  X(0x64, IDX,       lsr,   _)    X(0x65, IMM_IDX,   eim,   _)   \
+  X(0x66, IDX,       ror,   _)    X(0x67, IDX,       asr,   _)   \
+  X(0x68, IDX,       asl,   _)    X(0x69, IDX,       rol,   _)   \
+  X(0x6A, IDX,       dec,   _)    X(0x6B, IMM_IDX,   tim,   _)   \
+  X(0x6C, IDX,       inc,   _)    X(0x6D, IDX,       tst,   _)   \
+  X(0x6E, IDX,       jmp,   _)    X(0x6F, IDX,       clr,   _)   \
+  X(0x70, EXT,       neg,   _)    X(0x71, IMM_DIR,   aim,   _)   \
+  X(0x72, IMM_DIR,   oim,   _)    X(0x73, EXT,       com,   _)   \
+  X(0x74, EXT,       lsr,   _)    X(0x75, IMM_DIR,   eim,   _)   \
+  X(0x76, EXT,       ror,   _)    X(0x77, EXT,       asr,   _)   \
+  X(0x78, EXT,       asl,   _)    X(0x79, EXT,       rol,   _)   \
+  X(0x7A, EXT,       dec,   _)    X(0x7B, IMM_DIR,   tim,   _)   \
+  X(0x7C, EXT,       inc,   _)    X(0x7D, EXT,       tst,   _)   \
+  X(0x7E, EXT,       jmp,   _)    X(0x7F, EXT,       clr,   _)   \
+  X(0x80, IMM8,      sub,   a)    X(0x81, IMM8,      cmp,   a)   \
+  X(0x82, IMM8,      sbc,   a)    X(0x83, IMM16,     subd,  _)   \
+  X(0x84, IMM8,      and,   a)    X(0x85, IMM8,      bit,   a)   \
+  X(0x86, IMM8,      ld,    a)    X(0x87, INH,       none,  _)   \
+  X(0x88, IMM8,      eor,   a)    X(0x89, IMM8,      adc,   a)   \
+  X(0x8A, IMM8,      ora,   a)    X(0x8B, IMM8,      add,   a)   \
+  X(0x8C, IMM16,     cpx,   _)    X(0x8D, REL,       bsr,   _)   \
+  X(0x8E, IMM16,     ld16,  sp)   X(0x8F, INH,       none,  _)   \
+  X(0x90, DIR,       sub,   a)    X(0x91, DIR,       cmp,   a)   \
+  X(0x92, DIR,       sbc,   a)    X(0x93, DIR,       subd,  _)   \
+  X(0x94, DIR,       and,   a)    X(0x95, DIR,       bit,   a)   \
+  X(0x96, DIR,       ld,    a)    X(0x97, DIR,       st,    a)   \
+  X(0x98, DIR,       eor,   a)    X(0x99, DIR,       adc,   a)   \
+  X(0x9A, DIR,       ora,   a)    X(0x9B, DIR,       add,   a)   \
+  X(0x9C, DIR,       cpx,   _)    X(0x9D, DIR,       jsr,   _)   \
+  X(0x9E, DIR,       ld16,  sp)   X(0x9F, DIR,       st16,  sp)  \
+  X(0xA0, IDX,       sub,   a)    X(0xA1, IDX,       cmp,   a)   \
+  X(0xA2, IDX,       sbc,   a)    X(0xA3, IDX,       subd,  _)   \
+  X(0xA4, IDX,       and,   a)    X(0xA5, IDX,       bit,   a)   \
+  X(0xA6, IDX,       ld,    a)    X(0xA7, IDX,       st,    a)   \
+  X(0xA8, IDX,       eor,   a)    X(0xA9, IDX,       adc,   a)   \
+  X(0xAA, IDX,       ora,   a)    X(0xAB, IDX,       add,   a)   \
+  X(0xAC, IDX,       cpx,   _)    X(0xAD, IDX,       jsr,   _)   \
+  X(0xAE, IDX,       ld16,  sp)   X(0xAF, IDX,       st16,  sp)  \
+  X(0xB0, EXT,       sub,   a)    X(0xB1, EXT,       cmp,   a)   \
+  X(0xB2, EXT,       sbc,   a)    X(0xB3, EXT,       subd,  _)   \
+  X(0xB4, EXT,       and,   a)    X(0xB5, EXT,       bit,   a)   \
+  X(0xB6, EXT,       ld,    a)    X(0xB7, EXT,       st,    a)   \
+  X(0xB8, EXT,       eor,   a)    X(0xB9, EXT,       adc,   a)   \
+  X(0xBA, EXT,       ora,   a)    X(0xBB, EXT,       add,   a)   \
+  X(0xBC, EXT,       cpx,   _)    X(0xBD, EXT,       jsr,   _)   \
+  X(0xBE, EXT,       ld16,  sp)   X(0xBF, EXT,       st16,  sp)  \
+  X(0xC0, IMM8,      sub,   b)    X(0xC1, IMM8,      cmp,   b)   \
+  X(0xC2, IMM8,      sbc,   b)    X(0xC3, IMM16,     addd,  _)   \
+  X(0xC4, IMM8,      and,   b)    X(0xC5, IMM8,      bit,   b)   \
+  X(0xC6, IMM8,      ld,    b)    X(0xC7, INH,       none,  _)   \
+  X(0xC8, IMM8,      eor,   b)    X(0xC9, IMM8,      adc,   b)   \
+  X(0xCA, IMM8,      ora,   b)    X(0xCB, IMM8,      add,   b)   \
+  X(0xCC, IMM16,     ldd,   _)    X(0xCD, INH,       none,  _)   \
+  X(0xCE, IMM16,     ld16,  x)    X(0xCF, INH,       none,  _)   \
+  X(0xD0, DIR,       sub,   b)    X(0xD1, DIR,       cmp,   b)   \
+  X(0xD2, DIR,       sbc,   b)    X(0xD3, DIR,       addd,  _)   \
+  X(0xD4, DIR,       and,   b)    X(0xD5, DIR,       bit,   b)   \
+  X(0xD6, DIR,       ld,    b)    X(0xD7, DIR,       st,    b)   \
+  X(0xD8, DIR,       eor,   b)    X(0xD9, DIR,       adc,   b)   \
+  X(0xDA, DIR,       ora,   b)    X(0xDB, DIR,       add,   b)   \
+  X(0xDC, DIR,       ldd,   _)    X(0xDD, DIR,       std,   _)   \
+  X(0xDE, DIR,       ld16,  x)    X(0xDF, DIR,       st16,  x)   \
+  X(0xE0, IDX,       sub,   b)    X(0xE1, IDX,       cmp,   b)   \
+  X(0xE2, IDX,       sbc,   b)    X(0xE3, IDX,       addd,  _)   \
+  X(0xE4, IDX,       and,   b)    X(0xE5, IDX,       bit,   b)   \
+  X(0xE6, IDX,       ld,    b)    X(0xE7, IDX,       st,    b)   \
+  X(0xE8, IDX,       eor,   b)    X(0xE9, IDX,       adc,   b)   \
+  X(0xEA, IDX,       ora,   b)    X(0xEB, IDX,       add,   b)   \
+  X(0xEC, IDX,       ldd,   _)    X(0xED, IDX,       std,   _)   \
+  X(0xEE, IDX,       ld16,  x)    X(0xEF, IDX,       st16,  x)   \
+  X(0xF0, EXT,       sub,   b)    X(0xF1, EXT,       cmp,   b)   \
+  X(0xF2, EXT,       sbc,   b)    X(0xF3, EXT,       addd,  _)   \
+  X(0xF4, EXT,       and,   b)    X(0xF5, EXT,       bit,   b)   \
+  X(0xF6, EXT,       ld,    b)    X(0xF7, EXT,       st,    b)   \
+  X(0xF8, EXT,       eor,   b)    X(0xF9, EXT,       adc,   b)   \
+  X(0xFA, EXT,       ora,   b)    X(0xFB, EXT,       add,   b)   \
+  X(0xFC, EXT,       ldd,   _)    X(0xFD, EXT,       std,   _)   \
+  X(0xFE, EXT,       ld16,  x)    X(0xFF, EXT,       st16,  x)  
+
+/* Table core, each handler is generated from the spec around the same body as
+   the threaded core. Registers are loaded and spilled for every instruction,
+   so the lazy flags fold into eager ones: */
+#define HD6301_TABLE_FUNCTION(op, mode, operation, r) \
+  static void op_##op(hd6301_t *cpu, mem_t *mem) \
+  { \
+    uint8_t a, b; \
+    uint16_t x, sp, pc; \
+    uint8_t c, v, z, n, i, h, u; \
+    hd6301_lazy_t lazy_op; \
+    uint16_t lazy_x = 0, lazy_y = 0, lazy_r = 0; \
+    uint16_t operand = 0; \
+    uint16_t address = 0; \
+    uint64_t clock_start = 0; \
+    int elapsed = 0; \
+    HD6301_RELOAD() \
+    HD6301_FETCH_##mode \
+    HD6301_EA_##mode \
+    HD6301_OP_##operation(r, mode) \
+    HD6301_SPILL() \
+    (void)mem; \
+    (void)operand; \
+    (void)address; \
+    (void)clock_start; \
+    (void)elapsed; \
+  }
 
-static void op_asl_idx(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "asl", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  carry = (value & 0x80) >> 7;
-  value <<= 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+HD6301_OPCODE_SPEC(HD6301_TABLE_FUNCTION)
 
-static void op_asla(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "asla", NULL);
-  carry = (cpu->a & 0x80) >> 7;
-  cpu->a <<= 1;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+typedef void (*hd6301_operation_func_t)(hd6301_t *, mem_t *);
 
-static void op_aslb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "aslb", NULL);
-  carry = (cpu->b & 0x80) >> 7;
-  cpu->b <<= 1;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+/* Lean table, without any trace hooks: */
+#define HD6301_LEAN_ENTRY(op, mode, operation, r) op_##op,
 
-static void op_asld(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "asld", NULL);
-  carry = (cpu->d & 0x8000) >> 15;
-  cpu->d <<= 1;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+static hd6301_operation_func_t opcode_function_lean[UINT8_MAX + 1] = {
+  HD6301_OPCODE_SPEC(HD6301_LEAN_ENTRY)
+};
 
-static void op_asr_ext(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t value;
-  uint8_t keep;
-  uint16_t address;
-  hd6301_trace(cpu, "asr", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  carry = value & 1;
-  keep = value & 0x80;
-  value >>= 1;
-  value |= keep;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+/* Instrumented table, each entry records a trace before execution: */
+#define HD6301_TRACED_FUNCTION(op, mode, operation, r) \
+  static void op_##op##_traced(hd6301_t *cpu, mem_t *mem) \
+  { \
+    hd6301_trace(cpu, mem, op); \
+    op_##op(cpu, mem); \
+  }
+#define HD6301_TRACED_ENTRY(op, mode, operation, r) op_##op##_traced,
 
-static void op_asr_idx(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t value;
-  uint8_t keep;
-  uint16_t address;
-  hd6301_trace(cpu, "asr", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  carry = value & 1;
-  keep = value & 0x80;
-  value >>= 1;
-  value |= keep;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+HD6301_OPCODE_SPEC(HD6301_TRACED_FUNCTION)
 
-static void op_asra(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t keep;
-  hd6301_trace(cpu, "asra", NULL);
-  carry = cpu->a & 1;
-  keep = cpu->a & 0x80;
-  cpu->a >>= 1;
-  cpu->a |= keep;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+static hd6301_operation_func_t opcode_function_traced[UINT8_MAX + 1] = {
+  HD6301_OPCODE_SPEC(HD6301_TRACED_ENTRY)
+};
 
-static void op_asrb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  uint8_t keep;
-  hd6301_trace(cpu, "asrb", NULL);
-  carry = cpu->b & 1;
-  keep = cpu->b & 0x80;
-  cpu->b >>= 1;
-  cpu->b |= keep;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
+static hd6301_operation_func_t *opcode_function = opcode_function_lean;
 
-static void op_bcc(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bcc", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->c == 0) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_bcs(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bcs", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->c == 1) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_beq(hd6301_t *cpu, mem_t *mem)
+void hd6301_trace_enable(bool enable)
 {
-  int8_t relative;
-  hd6301_trace(cpu, "beq", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->z == 1) {
-    cpu->pc += relative;
+  hd6301_trace_active = enable;
+  if (enable) {
+    opcode_function = opcode_function_traced;
+  } else {
+    opcode_function = opcode_function_lean;
   }
 }
 
-static void op_bge(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bge", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->n ^ cpu->v) == 0) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_bgt(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bgt", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->z + (cpu->n ^ cpu->v)) == 0) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_bhi(hd6301_t *cpu, mem_t *mem)
+bool hd6301_trace_enabled(void)
 {
-  int8_t relative;
-  hd6301_trace(cpu, "bhi", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->c + cpu->z) == 0) {
-    cpu->pc += relative;
-  }
+  return hd6301_trace_active;
 }
 
-static void op_bita_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bita", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->a & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
 
-static void op_bita_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bita", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->a & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
 
-static void op_bita_idx(hd6301_t *cpu, mem_t *mem)
+void hd6301_execute(hd6301_t *cpu, mem_t *mem)
 {
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bita", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  result = cpu->a & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  uint8_t opcode;
 
-static void op_bita_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  hd6301_trace(cpu, "bita", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  result = cpu->a & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  if (hd6301_sci_irq_due(cpu, mem)) {
+    hd6301_irq(cpu, mem, HD6301_VECTOR_SCI_LOW, HD6301_VECTOR_SCI_HIGH);
+  }
 
-static void op_bitb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bitb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->b & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  if (cpu->sleep || cpu->wait) {
+    hd6301_counter_increment(cpu, mem, 1);
+    return;
+  }
 
-static void op_bitb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bitb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->b & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  /* Check for pending IRQ: */
+  if (cpu->irq_pending && (cpu->i == 0)) {
+    hd6301_irq(cpu, mem,
+      cpu->irq_pending_vector_low,
+      cpu->irq_pending_vector_high);
+    cpu->irq_pending = false;
+    cpu->irq_pending_vector_low  = 0x0;
+    cpu->irq_pending_vector_high = 0x0;
+  }
 
-static void op_bitb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "bitb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  result = cpu->b & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  opcode = mem_read(mem, cpu->pc++);
+  (opcode_function[opcode])(cpu, mem);
+  cpu->instructions++;
 
-static void op_bitb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  hd6301_trace(cpu, "bitb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  result = cpu->b & value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  hd6301_counter_increment(cpu, mem, opcode_cycles[opcode]);
 
-static void op_ble(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "ble", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->z + (cpu->n ^ cpu->v)) == 1) {
-    cpu->pc += relative;
+  if (cpu->pending & HD6301_PENDING_HOUSEKEEPING) {
+    hd6301_housekeeping(cpu, mem);
   }
 }
 
-static void op_bls(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bls", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->c + cpu->z) == 1) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_blt(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "blt", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if ((cpu->n ^ cpu->v) == 1) {
-    cpu->pc += relative;
-  }
-}
 
-static void op_bmi(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bmi", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->n == 1) {
-    cpu->pc += relative;
-  }
-}
-
-static void op_bne(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bne", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->z == 0) {
-    cpu->pc += relative;
-  }
-}
-
-static void op_bpl(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bpl", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->n == 0) {
-    cpu->pc += relative;
-  }
-}
-
-static void op_bra(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bra", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  cpu->pc += relative;
-}
-
-static void op_brn(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "brn", "%02x", mem_read(mem, cpu->pc));
-}
-
-static void op_bsr(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bsr", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  mem_write(mem, cpu->sp--, (cpu->pc) % 0x100);
-  mem_write(mem, cpu->sp--, (cpu->pc) / 0x100);
-  cpu->pc += relative;
-}
-
-static void op_bvc(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bvc", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->v == 0) {
-    cpu->pc += relative;
-  }
-}
-
-static void op_bvs(hd6301_t *cpu, mem_t *mem)
-{
-  int8_t relative;
-  hd6301_trace(cpu, "bvs", "%02x", mem_read(mem, cpu->pc));
-  relative = mem_read(mem, cpu->pc++);
-  if (cpu->v == 1) {
-    cpu->pc += relative;
-  }
-}
-
-static void op_cba(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  uint8_t result;
-  hd6301_trace(cpu, "cba", NULL);
-  result = cpu->a - cpu->b;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->a & ~cpu->b & ~result) | (~cpu->a & cpu->b & result)) >> 7;
-  cpu->c = ((~cpu->a & cpu->b) | (cpu->b & result) | (result & ~cpu->a)) >> 7;
-}
-
-static void op_clc(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "clc", NULL);
-  cpu->c = 0;
-}
-
-static void op_cli(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "cli", NULL);
-  cpu->i = 0;
-}
-
-static void op_clr_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "clr", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, 0);
-  cpu->n = 0;
-  cpu->z = 1;
-  cpu->v = 0;
-  cpu->c = 0;
-}
-
-static void op_clr_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "clr", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, 0);
-  cpu->n = 0;
-  cpu->z = 1;
-  cpu->v = 0;
-  cpu->c = 0;
-}
-
-static void op_clra(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "clra", NULL);
-  cpu->a = 0;
-  cpu->n = 0;
-  cpu->z = 1;
-  cpu->v = 0;
-  cpu->c = 0;
-}
-
-static void op_clrb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "clrb", NULL);
-  cpu->b = 0;
-  cpu->n = 0;
-  cpu->z = 1;
-  cpu->v = 0;
-  cpu->c = 0;
-}
-
-static void op_clv(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "clv", NULL);
-  cpu->v = 0;
-}
-
-static void op_cmpa_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpa", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->a - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->a & ~value & ~result) | (~cpu->a & value & result)) >> 7;
-  cpu->c = ((~cpu->a & value) | (value & result) | (result & ~cpu->a)) >> 7;
-}
-
-static void op_cmpa_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpa", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->a - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->a & ~value & ~result) | (~cpu->a & value & result)) >> 7;
-  cpu->c = ((~cpu->a & value) | (value & result) | (result & ~cpu->a)) >> 7;
-}
-
-static void op_cmpa_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpa", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  result = cpu->a - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->a & ~value & ~result) | (~cpu->a & value & result)) >> 7;
-  cpu->c = ((~cpu->a & value) | (value & result) | (result & ~cpu->a)) >> 7;
-}
-
-static void op_cmpa_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  hd6301_trace(cpu, "cmpa", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  result = cpu->a - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->a & ~value & ~result) | (~cpu->a & value & result)) >> 7;
-  cpu->c = ((~cpu->a & value) | (value & result) | (result & ~cpu->a)) >> 7;
-}
-
-static void op_cmpb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->b - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->b & ~value & ~result) | (~cpu->b & value & result)) >> 7;
-  cpu->c = ((~cpu->b & value) | (value & result) | (result & ~cpu->b)) >> 7;
-}
-
-static void op_cmpb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  result = cpu->b - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->b & ~value & ~result) | (~cpu->b & value & result)) >> 7;
-  cpu->c = ((~cpu->b & value) | (value & result) | (result & ~cpu->b)) >> 7;
-}
-
-static void op_cmpb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cmpb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  result = cpu->b - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->b & ~value & ~result) | (~cpu->b & value & result)) >> 7;
-  cpu->c = ((~cpu->b & value) | (value & result) | (result & ~cpu->b)) >> 7;
-}
-
-static void op_cmpb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t result;
-  hd6301_trace(cpu, "cmpb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  result = cpu->b - value;
-  cpu->n = (result & 0x80) >> 7;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->b & ~value & ~result) | (~cpu->b & value & result)) >> 7;
-  cpu->c = ((~cpu->b & value) | (value & result) | (result & ~cpu->b)) >> 7;
-}
-
-static void op_com_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "com", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  value = ~value;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 1;
-}
-
-static void op_com_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "com", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  value = ~value;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 1;
-}
-
-static void op_coma(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "coma", NULL);
-  cpu->a = ~cpu->a;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 1;
-}
-
-static void op_comb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "comb", NULL);
-  cpu->b = ~cpu->b;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 1;
-}
-
-static void op_cpx_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cpx", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  result = cpu->x - value;
-  cpu->n = (result & 0x8000) >> 15;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->x & ~value & ~result) | (~cpu->x & value & result)) >> 15;
-  cpu->c = ((~cpu->x & value) | (value & result) | (result & ~cpu->x)) >> 15;
-}
-
-static void op_cpx_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cpx", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  result = cpu->x - value;
-  cpu->n = (result & 0x8000) >> 15;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->x & ~value & ~result) | (~cpu->x & value & result)) >> 15;
-  cpu->c = ((~cpu->x & value) | (value & result) | (result & ~cpu->x)) >> 15;
-}
-
-static void op_cpx_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t result;
-  uint16_t address;
-  hd6301_trace(cpu, "cpx", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  result = cpu->x - value;
-  cpu->n = (result & 0x8000) >> 15;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->x & ~value & ~result) | (~cpu->x & value & result)) >> 15;
-  cpu->c = ((~cpu->x & value) | (value & result) | (result & ~cpu->x)) >> 15;
-}
-
-static void op_cpx_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t result;
-  hd6301_trace(cpu, "cpx", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++) * 0x100;
-  value += mem_read(mem, cpu->pc++);
-  result = cpu->x - value;
-  cpu->n = (result & 0x8000) >> 15;
-  cpu->z = result == 0 ? 1 : 0;
-  cpu->v = ((cpu->x & ~value & ~result) | (~cpu->x & value & result)) >> 15;
-  cpu->c = ((~cpu->x & value) | (value & result) | (result & ~cpu->x)) >> 15;
-}
-
-static void op_daa(hd6301_t *cpu, mem_t *mem)
-{
-  (void)cpu;
-  (void)mem;
-  panic("DAA not implemented!\n");
-}
-
-static void op_dec_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "dec", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  value -= 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x7f ? 1 : 0;
-}
-
-static void op_dec_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "dec", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  value -= 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x7f ? 1 : 0;
-}
-
-static void op_deca(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "deca", NULL);
-  cpu->a--;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->a == 0x7f ? 1 : 0;
-}
-
-static void op_decb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "decb", NULL);
-  cpu->b--;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->b == 0x7f ? 1 : 0;
-}
-
-static void op_des(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "des", NULL);
-  cpu->sp--;
-}
-
-static void op_dex(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "dex", NULL);
-  cpu->x--;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-}
-
-static void op_eim_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eim", "#%02x, %02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++);
-  value ^= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eim_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eim", "#%02x, %02x,x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value ^= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eora_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eora", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a ^= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eora_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eora", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a ^= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eora_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eora", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->a ^= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eora_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "eora", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->a ^= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eorb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eorb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b ^= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eorb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eorb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b ^= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eorb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "eorb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->b ^= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_eorb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "eorb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->b ^= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_inc_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "inc", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  value += 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x80 ? 1 : 0;
-}
-
-static void op_inc_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "inc", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  value += 1;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x80 ? 1 : 0;
-}
-
-static void op_inca(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "inca", NULL);
-  cpu->a++;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->a == 0x80 ? 1 : 0;
-}
-
-static void op_incb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "incb", NULL);
-  cpu->b++;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->b == 0x80 ? 1 : 0;
-}
-
-static void op_ins(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "ins", NULL);
-  cpu->sp++;
-}
-
-static void op_inx(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "inx", NULL);
-  cpu->x++;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-}
-
-static void op_jmp_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "jmp", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->pc = address;
-}
-
-static void op_jmp_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "jmp", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->pc = address;
-}
-
-static void op_jsr_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "jsr", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, cpu->sp--, (cpu->pc) % 0x100);
-  mem_write(mem, cpu->sp--, (cpu->pc) / 0x100);
-  cpu->pc = address;
-}
-
-static void op_jsr_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "jsr", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, cpu->sp--, (cpu->pc) % 0x100);
-  mem_write(mem, cpu->sp--, (cpu->pc) / 0x100);
-  cpu->pc = address;
-}
-
-static void op_jsr_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "jsr", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, cpu->sp--, (cpu->pc) % 0x100);
-  mem_write(mem, cpu->sp--, (cpu->pc) / 0x100);
-  cpu->pc = address;
-}
-
-static void op_ldaa_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldaa", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  cpu->a = mem_read(mem, address);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldaa_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldaa", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->a = mem_read(mem, address);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldaa_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldaa", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->a = mem_read(mem, address);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldaa_imm(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "ldaa", "#%02x", mem_read(mem, cpu->pc));
-  cpu->a = mem_read(mem, cpu->pc++);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldab_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldab", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  cpu->b = mem_read(mem, address);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldab_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldab", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->b = mem_read(mem, address);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldab_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldab", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->b = mem_read(mem, address);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldab_imm(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "ldab", "#%02x", mem_read(mem, cpu->pc));
-  cpu->b = mem_read(mem, cpu->pc++);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldd_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldd", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  cpu->d = mem_read(mem, address) * 0x100;
-  cpu->d += mem_read(mem, address + 1);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldd_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldd", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->d = mem_read(mem, address) * 0x100;
-  cpu->d += mem_read(mem, address + 1);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldd_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldd", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->d = mem_read(mem, address) * 0x100;
-  cpu->d += mem_read(mem, address + 1);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldd_imm(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "ldd", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  cpu->d = mem_read(mem, cpu->pc++) * 0x100;
-  cpu->d += mem_read(mem, cpu->pc++);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_lds_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "lds", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  cpu->sp = mem_read(mem, address) * 0x100;
-  cpu->sp += mem_read(mem, address + 1);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_lds_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "lds", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->sp = mem_read(mem, address) * 0x100;
-  cpu->sp += mem_read(mem, address + 1);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_lds_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "lds", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->sp = mem_read(mem, address) * 0x100;
-  cpu->sp += mem_read(mem, address + 1);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_lds_imm(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "lds", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  cpu->sp = mem_read(mem, cpu->pc++) * 0x100;
-  cpu->sp += mem_read(mem, cpu->pc++);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldx_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldx", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  cpu->x = mem_read(mem, address) * 0x100;
-  cpu->x += mem_read(mem, address + 1);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldx_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldx", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  cpu->x = mem_read(mem, address) * 0x100;
-  cpu->x += mem_read(mem, address + 1);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldx_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "ldx", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  cpu->x = mem_read(mem, address) * 0x100;
-  cpu->x += mem_read(mem, address + 1);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_ldx_imm(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "ldx", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  cpu->x = mem_read(mem, cpu->pc++) * 0x100;
-  cpu->x += mem_read(mem, cpu->pc++);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_lsr_ext(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "lsr", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  carry = value & 1;
-  value >>= 1;
-  mem_write(mem, address, value);
-  cpu->n = 0;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_lsr_idx(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "lsr", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  carry = value & 1;
-  value >>= 1;
-  mem_write(mem, address, value);
-  cpu->n = 0;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_lsra(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "lsra", NULL);
-  carry = cpu->a & 1;
-  cpu->a >>= 1;
-  cpu->n = 0;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_lsrb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "lsrb", NULL);
-  carry = cpu->b & 1;
-  cpu->b >>= 1;
-  cpu->n = 0;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_lsrd(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "lsrd", NULL);
-  carry = cpu->d & 1;
-  cpu->d >>= 1;
-  cpu->n = 0;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_mul(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  uint16_t result;
-  hd6301_trace(cpu, "mul", NULL);
-  result = cpu->a * cpu->b;
-  cpu->a = result / 0x100;
-  cpu->b = result % 0x100;
-  cpu->c = (cpu->b & 0x80) >> 7;
-}
-
-static void op_neg_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "neg", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  value = (value == 0x80 ? 0x80 : -value);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x80 ? 1 : 0;
-  cpu->c = value == 0 ? 0 : 1;
-}
-
-static void op_neg_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "neg", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  value = (value == 0x80 ? 0x80 : -value);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = value == 0x80 ? 1 : 0;
-  cpu->c = value == 0 ? 0 : 1;
-}
-
-static void op_nega(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "nega", NULL);
-  cpu->a = (cpu->a == 0x80 ? 0x80 : -cpu->a);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->a == 0x80 ? 1 : 0;
-  cpu->c = cpu->a == 0 ? 0 : 1;
-}
-
-static void op_negb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "negb", NULL);
-  cpu->b = (cpu->b == 0x80 ? 0x80 : -cpu->b);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->b == 0x80 ? 1 : 0;
-  cpu->c = cpu->b == 0 ? 0 : 1;
-}
-
-static void op_nop(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "nop", NULL);
-}
-
-static void op_oim_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "oim", "#%02x, %02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++);
-  value |= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_oim_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "oim", "#%02x, %02x,x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value |= mem_read(mem, address);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_oraa_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "oraa", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a |= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_oraa_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "oraa", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->a |= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_oraa_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "oraa", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->a |= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_oraa_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "oraa", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->a |= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_orab_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "orab", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b |= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_orab_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "orab", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->b |= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_orab_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "orab", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->b |= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_orab_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  hd6301_trace(cpu, "orab", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  cpu->b |= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_psha(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "psha", NULL);
-  mem_write(mem, cpu->sp--, cpu->a);
-}
-
-static void op_pshb(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "pshb", NULL);
-  mem_write(mem, cpu->sp--, cpu->b);
-}
-
-static void op_pshx(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "pshx", NULL);
-  mem_write(mem, cpu->sp--, (cpu->x) % 0x100);
-  mem_write(mem, cpu->sp--, (cpu->x) / 0x100);
-}
-
-static void op_pula(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "pula", NULL);
-  cpu->a = mem_read(mem, ++cpu->sp);
-}
-
-static void op_pulb(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "pulb", NULL);
-  cpu->b = mem_read(mem, ++cpu->sp);
-}
-
-static void op_pulx(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "pulx", NULL);
-  cpu->x = mem_read(mem, ++cpu->sp) * 0x100;
-  cpu->x += mem_read(mem, ++cpu->sp);
-}
-
-static void op_rol_ext(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "rol", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  carry = (value & 0x80) >> 7;
-  value <<= 1;
-  value |= cpu->c;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rol_idx(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "rol", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  carry = (value & 0x80) >> 7;
-  value <<= 1;
-  value |= cpu->c;
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rola(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "rola", NULL);
-  carry = (cpu->a & 0x80) >> 7;
-  cpu->a <<= 1;
-  cpu->a |= cpu->c;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rolb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "rolb", NULL);
-  carry = (cpu->b & 0x80) >> 7;
-  cpu->b <<= 1;
-  cpu->b |= cpu->c;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_ror_ext(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "ror", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  carry = value & 1;
-  value >>= 1;
-  value |= (cpu->c << 7);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_ror_idx(hd6301_t *cpu, mem_t *mem)
-{
-  bool carry;
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "ror", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  carry = value & 1;
-  value >>= 1;
-  value |= (cpu->c << 7);
-  mem_write(mem, address, value);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rora(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "rora", NULL);
-  carry = cpu->a & 1;
-  cpu->a >>= 1;
-  cpu->a |= (cpu->c << 7);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rorb(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  bool carry;
-  hd6301_trace(cpu, "rorb", NULL);
-  carry = cpu->b & 1;
-  cpu->b >>= 1;
-  cpu->b |= (cpu->c << 7);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = cpu->n ^ carry;
-  cpu->c = carry;
-}
-
-static void op_rti(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "rti", NULL);
-  cpu->ccr = mem_read(mem, ++cpu->sp);
-  cpu->b = mem_read(mem, ++cpu->sp);
-  cpu->a = mem_read(mem, ++cpu->sp);
-  cpu->x = mem_read(mem, ++cpu->sp) * 0x100;
-  cpu->x += mem_read(mem, ++cpu->sp);
-  cpu->pc = mem_read(mem, ++cpu->sp) * 0x100;
-  cpu->pc += mem_read(mem, ++cpu->sp);
-}
-
-static void op_rts(hd6301_t *cpu, mem_t *mem)
-{
-  hd6301_trace(cpu, "rts", NULL);
-  cpu->pc = mem_read(mem, ++cpu->sp) * 0x100;
-  cpu->pc += mem_read(mem, ++cpu->sp);
-}
-
-static void op_sec(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "sec", NULL);
-  cpu->c = 1;
-}
-
-static void op_sei(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "sei", NULL);
-  cpu->i = 1;
-}
-
-static void op_sev(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "sev", NULL);
-  cpu->v = 1;
-}
-
-static void op_slp(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "slp", NULL);
-  cpu->sleep = true;
-}
-
-static void op_staa_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "staa", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->a);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_staa_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "staa", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->a);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_staa_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "staa", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, cpu->a);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stab_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stab", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->b);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stab_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stab", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->b);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stab_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stab", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, cpu->b);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_sba(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  uint8_t prev;
-  hd6301_trace(cpu, "sba", NULL);
-  prev = cpu->a;
-  cpu->a = cpu->a - cpu->b;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~cpu->b & ~cpu->a) | (~prev & cpu->b & cpu->a)) >> 7;
-  cpu->c = ((~prev & cpu->b) | (cpu->b & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_sbca_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbca", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->a -= cpu->c;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_sbca_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbca", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->a -= cpu->c;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_sbca_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbca", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->a -= cpu->c;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_sbca_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "sbca", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->a -= cpu->c;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_sbcb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbcb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->b -= cpu->c;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
-
-static void op_sbcb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbcb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->b -= cpu->c;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
-
-static void op_sbcb_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "sbcb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->b -= cpu->c;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
-
-static void op_sbcb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "sbcb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->b -= cpu->c;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
-
-static void op_std_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "std", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->a);
-  mem_write(mem, address + 1, cpu->b);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_std_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "std", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->a);
-  mem_write(mem, address + 1, cpu->b);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_std_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "std", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, cpu->a);
-  mem_write(mem, address + 1, cpu->b);
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_sts_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "sts", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->sp / 0x100);
-  mem_write(mem, address + 1, cpu->sp % 0x100);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_sts_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "sts", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->sp / 0x100);
-  mem_write(mem, address + 1, cpu->sp % 0x100);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_sts_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "sts", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, cpu->sp / 0x100);
-  mem_write(mem, address + 1, cpu->sp % 0x100);
-  cpu->n = (cpu->sp & 0x8000) >> 15;
-  cpu->z = cpu->sp == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stx_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stx", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->x / 0x100);
-  mem_write(mem, address + 1, cpu->x % 0x100);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stx_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stx", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  mem_write(mem, address, cpu->x / 0x100);
-  mem_write(mem, address + 1, cpu->x % 0x100);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_stx_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t address;
-  hd6301_trace(cpu, "stx", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  mem_write(mem, address, cpu->x / 0x100);
-  mem_write(mem, address + 1, cpu->x % 0x100);
-  cpu->n = (cpu->x & 0x8000) >> 15;
-  cpu->z = cpu->x == 0 ? 1 : 0;
-  cpu->v = 0;
-}
-
-static void op_suba_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "suba", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_suba_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "suba", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
-
-static void op_suba_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "suba", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
+/* Checks needed before an instruction, like the start of hd6301_execute(): */
+#define HD6301_ATTENTION \
+  ((cpu->pending & HD6301_PENDING_SCI_IRQ) || \
+   cpu->sleep || cpu->wait || (cpu->irq_pending && (i == 0)))
+
+#ifdef HD6301_THREADED_GOTO
+#define HD6301_THREADED_ADDRESS(op, mode, operation, r) &&opcode_##op,
+#define HD6301_DECODED_ADDRESS(op, mode, operation, r) &&decoded_##op,
+#define HD6301_BLOCK_ADDRESS(op, mode, operation, r) &&block_##op,
+#define HD6301_THREADED_LABEL(op) opcode_##op:
+#define HD6301_THREADED_DISPATCH() goto *dispatch[opcode];
+#define HD6301_DECODED_DISPATCH() goto *decoded->handler;
+#define HD6301_IDLE_RESUME() goto *handler[decoded->opcode];
+#define HD6301_BLOCK_DISPATCH() \
+  if (block_op == block_end) { \
+    goto block_done; \
+  } \
+  goto *block_op->handler;
+#else
+#define HD6301_DECODED_CASE(op, mode, operation, r) case op: goto decoded_##op;
+#define HD6301_BLOCK_CASE(op, mode, operation, r) case op: goto block_##op;
+#define HD6301_THREADED_LABEL(op) case op:
+#define HD6301_THREADED_DISPATCH() goto dispatch;
+#define HD6301_DECODED_DISPATCH() \
+  opcode = decoded->opcode; \
+  if (decoded->idle != HD6301_IDLE_NONE) { \
+    goto idle; \
+  } \
+  goto dispatch_decoded;
+#define HD6301_IDLE_RESUME() goto dispatch_decoded;
+#define HD6301_BLOCK_DISPATCH() goto block_dispatch;
+#endif /* HD6301_THREADED_GOTO */
+
+/* Run from a predecoded entry, skipping the operand fetch: */
+#define HD6301_DECODED() \
+  operand = decoded->operand; \
+  address = decoded->address; \
+  pc = decoded->next_pc; \
+  HD6301_DECODED_DISPATCH()
+
+/* ROM above the RAM area never changes, so it can be predecoded. RAM above
+   the zero page is predecoded too, but checked against page writes: */
+#define HD6301_THREADED_FETCH() \
+  if (pc > mem->ram_max) { \
+    if (hd6301_jit_active) { \
+      goto jit; \
+    } \
+    decoded = &decoded_table[pc]; \
+    if (! decoded->valid) { \
+      goto predecode; \
+    } \
+    HD6301_DECODED() \
+  } \
+  if (pc >= MEM_PAGE_SIZE) { \
+    decoded = &decoded_table[pc]; \
+    if (! decoded->valid || \
+      decoded->generation != mem->generation[pc / MEM_PAGE_SIZE]) { \
+      goto predecode; \
+    } \
+    HD6301_DECODED() \
+  } \
+  opcode = mem_read(mem, pc++); \
+  HD6301_THREADED_DISPATCH()
+
+/* Each body has its own housekeeping fast path and dispatch to the next: */
+#define HD6301_THREADED_BODY(op, mode, operation, r) \
+  HD6301_THREADED_LABEL(op) \
+    HD6301_FETCH_##mode \
+  decoded_##op: \
+    HD6301_EA_##mode \
+    HD6301_OP_##operation(r, mode) \
+    step_cycles = opcode_cycles[op]; \
+    if ((uint16_t)(cpu->timer_event - cpu->counter) < step_cycles) { \
+      goto counter_slow; \
+    } \
+    cpu->counter += step_cycles; \
+    cpu->clock += step_cycles; \
+    elapsed += step_cycles; \
+    if (cpu->pending & HD6301_PENDING_HOUSEKEEPING) { \
+      goto housekeeping; \
+    } \
+    if (elapsed >= cycles || cpu->sync_event) { \
+      goto done; \
+    } \
+    if (HD6301_ATTENTION) { \
+      goto attention; \
+    } \
+    HD6301_THREADED_FETCH()
+
+/* Accesses that must be left to the interpreter, also for 16-bit values: */
+#define HD6301_JIT_IO(address) \
+  ((address) < HD6301_JIT_IO_END || (address) == UINT16_MAX)
+
+/* Pushes reach down to SP - 1 and RTI pulls up to SP + 7: */
+#define HD6301_GUARD_FAILED(guard) \
+  ((guard) == HD6301_GUARD_ADDRESS ? HD6301_JIT_IO(address) : \
+    (sp <= HD6301_JIT_IO_END || sp > UINT16_MAX - 7))
+
+/* Block body, no housekeeping since I/O and IRQ changes end the block: */
+#define HD6301_BLOCK_BODY(op, mode, operation, r) \
+  block_##op: \
+    operand = block_op->operand; \
+    address = block_op->address; \
+    pc = block_op->next_pc; \
+    HD6301_EA_##mode \
+    if (block_op->guard != HD6301_GUARD_NONE && \
+      HD6301_GUARD_FAILED(block_op->guard)) { \
+      goto block_exit; \
+    } \
+    HD6301_OP_##operation(r, mode) \
+    block_cycles += opcode_cycles[op]; \
+    block_op++; \
+    HD6301_BLOCK_DISPATCH()
+
+/* The block was checked to not reach the OCR, so just add up the cycles: */
+#define HD6301_BLOCK_COUNTER_INCREMENT() \
+  cpu->counter += block_cycles; \
+  cpu->clock += block_cycles; \
+  elapsed += block_cycles;
+
+/* Instruction size in bytes for each addressing mode: */
+static const int hd6301_mode_size[] = {
+  [HD6301_MODE_INH]     = 1,
+  [HD6301_MODE_IMM8]    = 2,
+  [HD6301_MODE_IMM16]   = 3,
+  [HD6301_MODE_DIR]     = 2,
+  [HD6301_MODE_EXT]     = 3,
+  [HD6301_MODE_IDX]     = 2,
+  [HD6301_MODE_REL]     = 2,
+  [HD6301_MODE_IMM_DIR] = 3,
+  [HD6301_MODE_IMM_IDX] = 3,
+};
 
-static void op_suba_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "suba", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->a;
-  cpu->a -= value;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->a) | (~prev & value & cpu->a)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->a) | (cpu->a & ~prev)) >> 7;
-}
+/* Reads that may give a new value each time, with no store in between: */
+static bool hd6301_idle_volatile(uint16_t address)
+{
+  return address == HD6301_REG_FRC_HIGH ||
+         address == HD6301_REG_FRC_LOW ||
+         address == MASTER_IO_LCD_DATA ||
+         (address >= MASTER_RTC_SECONDS && address <= MASTER_RTC_REGISTER_D);
+}
+
+/* Instructions that neither store, stack nor change the flow: */
+static bool hd6301_idle_safe(uint8_t opcode)
+{
+  switch (opcode) {
+  case 0x6B: /* TIM */
+  case 0x7B:
+  case 0x6D: /* TST */
+  case 0x7D:
+    return true;
+
+  case 0x06: /* TAP */
+  case 0x0E: /* CLI */
+  case 0x0F: /* SEI */
+  case 0x8D: /* BSR */
+  case 0x97: /* STAA */
+  case 0xA7:
+  case 0xB7:
+  case 0xD7: /* STAB */
+  case 0xE7:
+  case 0xF7:
+  case 0x9D: /* JSR */
+  case 0xAD:
+  case 0xBD:
+  case 0x9F: /* STS */
+  case 0xAF:
+  case 0xBF:
+  case 0xDD: /* STD */
+  case 0xED:
+  case 0xFD:
+  case 0xDF: /* STX */
+  case 0xEF:
+  case 0xFF:
+    return false;
 
-static void op_subb_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "subb", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
+  default:
+    if (opcode_cycles[opcode] == 0) {
+      return false;
+    }
+    /* Register transfers and operations, and loads or tests of memory: */
+    return opcode <= 0x18 || opcode == 0x1B ||
+      opcode == 0x30 || opcode == 0x31 || opcode == 0x34 || opcode == 0x35 ||
+      opcode == 0x3A || opcode == 0x3D ||
+      (opcode >= 0x40 && opcode <= 0x5F) || opcode >= 0x80;
+  }
 }
 
-static void op_subb_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "subb", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
+/* Branch conditions, from the CCR value: */
+static bool hd6301_idle_taken(uint8_t opcode, uint8_t ccr)
+{
+  bool c = ccr & 1;
+  bool v = (ccr >> 1) & 1;
+  bool z = (ccr >> 2) & 1;
+  bool n = (ccr >> 3) & 1;
+
+  switch (opcode) {
+  case 0x20: /* BRA */
+    return true;
+  case 0x22: /* BHI */
+    return (c || z) == 0;
+  case 0x23: /* BLS */
+    return (c || z) == 1;
+  case 0x24: /* BCC */
+    return c == 0;
+  case 0x25: /* BCS */
+    return c == 1;
+  case 0x26: /* BNE */
+    return z == 0;
+  case 0x27: /* BEQ */
+    return z == 1;
+  case 0x28: /* BVC */
+    return v == 0;
+  case 0x29: /* BVS */
+    return v == 1;
+  case 0x2A: /* BPL */
+    return n == 0;
+  case 0x2B: /* BMI */
+    return n == 1;
+  case 0x2C: /* BGE */
+    return (n ^ v) == 0;
+  case 0x2D: /* BLT */
+    return (n ^ v) == 1;
+  case 0x2E: /* BGT */
+    return (z || (n ^ v)) == 0;
+  case 0x2F: /* BLE */
+    return (z || (n ^ v)) == 1;
+  default:
+    return false;
+  }
 }
 
-static void op_subb_idx(hd6301_t *cpu, mem_t *mem)
+/* Check if a ROM branch goes back to the start of a loop that can be skipped,
+   and find the cycles used by one iteration: */
+static hd6301_idle_t hd6301_idle_loop(mem_t *mem, uint16_t pc, uint8_t opcode,
+  uint16_t target, uint8_t *cycles)
 {
-  uint8_t value;
-  uint8_t prev;
+  uint8_t body;
   uint16_t address;
-  hd6301_trace(cpu, "subb", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
+  int total;
 
-static void op_subb_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint8_t prev;
-  hd6301_trace(cpu, "subb", "#%02x", mem_read(mem, cpu->pc));
-  value = mem_read(mem, cpu->pc++);
-  prev = cpu->b;
-  cpu->b -= value;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = ((prev & ~value & ~cpu->b) | (~prev & value & cpu->b)) >> 7;
-  cpu->c = ((~prev & value) | (value & cpu->b) | (cpu->b & ~prev)) >> 7;
-}
+  if (opcode < 0x20 || opcode > 0x2F || opcode == 0x21 ||
+      target <= mem->ram_max || target >= pc ||
+      pc - target > HD6301_IDLE_LOOP_MAX) {
+    return HD6301_IDLE_NONE;
+  }
 
-static void op_subd_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "subd", "%02x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d -= value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = (prev & ~value & ~cpu->d & ~prev & value & cpu->d) >> 15;
-  cpu->c = ((~prev & value) | (value & cpu->d) | (cpu->d & ~prev)) >> 15;
-}
+  if (opcode == 0x26 && pc - target == 1) { /* BNE */
+    total = opcode_cycles[mem->ram[target]] + opcode_cycles[opcode];
+    *cycles = total;
+    switch (mem->ram[target]) {
+    case 0x09:
+      return HD6301_IDLE_DEX;
+    case 0x4A:
+      return HD6301_IDLE_DECA;
+    case 0x5A:
+      return HD6301_IDLE_DECB;
+    default:
+      break;
+    }
+  }
 
-static void op_subd_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "subd", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d -= value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = (prev & ~value & ~cpu->d & ~prev & value & cpu->d) >> 15;
-  cpu->c = ((~prev & value) | (value & cpu->d) | (cpu->d & ~prev)) >> 15;
-}
+  total = opcode_cycles[opcode];
+  while (target < pc) {
+    body = mem->ram[target];
+    if (! hd6301_idle_safe(body)) {
+      return HD6301_IDLE_NONE;
+    }
 
-static void op_subd_idx(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  uint16_t address;
-  hd6301_trace(cpu, "subd", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address) * 0x100;
-  value += mem_read(mem, address + 1);
-  prev = cpu->d;
-  cpu->d -= value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = (prev & ~value & ~cpu->d & ~prev & value & cpu->d) >> 15;
-  cpu->c = ((~prev & value) | (value & cpu->d) | (cpu->d & ~prev)) >> 15;
-}
+    switch (opcode_info[body].mode) {
+    case HD6301_MODE_DIR:
+      address = mem->ram[target + 1];
+      break;
+    case HD6301_MODE_EXT:
+      address = (mem->ram[target + 1] * 0x100) + mem->ram[target + 2];
+      break;
+    case HD6301_MODE_IMM_DIR:
+      address = mem->ram[target + 2];
+      break;
+    case HD6301_MODE_IDX:
+    case HD6301_MODE_IMM_IDX:
+    case HD6301_MODE_REL:
+      return HD6301_IDLE_NONE; /* Unknown address or a branch. */
+    default:
+      address = 0;
+      break;
+    }
+    if (address != 0 && (hd6301_idle_volatile(address) ||
+      hd6301_idle_volatile(address + 1))) {
+      return HD6301_IDLE_NONE;
+    }
 
-static void op_subd_imm(hd6301_t *cpu, mem_t *mem)
-{
-  uint16_t value;
-  uint16_t prev;
-  hd6301_trace(cpu, "subd", "#%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++) * 0x100;
-  value += mem_read(mem, cpu->pc++);
-  prev = cpu->d;
-  cpu->d -= value;
-  cpu->n = (cpu->d & 0x8000) >> 15;
-  cpu->z = cpu->d == 0 ? 1 : 0;
-  cpu->v = (prev & ~value & ~cpu->d & ~prev & value & cpu->d) >> 15;
-  cpu->c = ((~prev & value) | (value & cpu->d) | (cpu->d & ~prev)) >> 15;
-}
+    total += opcode_cycles[body];
+    target += hd6301_mode_size[opcode_info[body].mode];
+  }
 
-static void op_swi(hd6301_t *cpu, mem_t *mem)
-{
-  (void)cpu;
-  (void)mem;
-  panic("SWI not implemented!\n");
+  if (target != pc || total > UINT8_MAX) {
+    return HD6301_IDLE_NONE;
+  }
+  *cycles = total;
+  return HD6301_IDLE_POLL;
 }
 
-static void op_tab(hd6301_t *cpu, mem_t *mem)
+static bool hd6301_predecode(mem_t *mem, uint16_t pc,
+  hd6301_decoded_t *decoded, const void *handler[])
 {
-  (void)mem;
-  hd6301_trace(cpu, "tab", NULL);
-  cpu->b = cpu->a;
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  uint8_t opcode;
+  uint16_t operand = 0;
+  uint16_t address = 0;
 
-static void op_tap(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "tap", NULL);
-  cpu->ccr = cpu->a;
-}
+  opcode = mem->ram[pc];
+  if (pc + hd6301_mode_size[opcode_info[opcode].mode] > UINT16_MAX + 1) {
+    return false; /* Operands would wrap around into RAM. */
+  }
+  if (pc <= mem->ram_max && (pc % MEM_PAGE_SIZE) +
+    hd6301_mode_size[opcode_info[opcode].mode] > MEM_PAGE_SIZE) {
+    return false; /* Only one page generation is checked. */
+  }
+  decoded->generation = mem->generation[pc / MEM_PAGE_SIZE];
+  pc++;
 
-static void op_tba(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "tba", NULL);
-  cpu->a = cpu->b;
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  switch (opcode_info[opcode].mode) {
+  case HD6301_MODE_IMM8:
+    HD6301_FETCH_IMM8
+    break;
+  case HD6301_MODE_IMM16:
+    HD6301_FETCH_IMM16
+    break;
+  case HD6301_MODE_DIR:
+    HD6301_FETCH_DIR
+    break;
+  case HD6301_MODE_EXT:
+    HD6301_FETCH_EXT
+    break;
+  case HD6301_MODE_IDX:
+    HD6301_FETCH_IDX
+    break;
+  case HD6301_MODE_REL:
+    HD6301_FETCH_REL
+    break;
+  case HD6301_MODE_IMM_DIR:
+    HD6301_FETCH_IMM_DIR
+    break;
+  case HD6301_MODE_IMM_IDX:
+    HD6301_FETCH_IMM_IDX
+    break;
+  case HD6301_MODE_INH:
+  default:
+    break;
+  }
 
-static void op_tim_dir(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "tim", "#%02x, %02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++);
-  value &= mem_read(mem, address);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
+  decoded->handler = (handler != NULL) ? handler[opcode] : NULL;
+  decoded->operand = operand;
+  decoded->address = address;
+  decoded->next_pc = pc;
+  decoded->opcode  = opcode;
+  decoded->valid   = true;
+
+  decoded->idle = HD6301_IDLE_NONE;
+  if (opcode_info[opcode].mode == HD6301_MODE_REL) {
+    decoded->idle = hd6301_idle_loop(mem, pc - 2, opcode,
+      pc + (int8_t)operand, &decoded->idle_cycles);
+  }
+  return true;
 }
 
-static void op_tim_idx(hd6301_t *cpu, mem_t *mem)
+static hd6301_guard_t hd6301_jit_guard(uint8_t opcode)
 {
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "tim", "#%02x, %02x,x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  value = mem_read(mem, cpu->pc++);
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value &= mem_read(mem, address);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-}
+  switch (opcode) {
+  case 0x32: /* PULA */
+  case 0x33: /* PULB */
+  case 0x36: /* PSHA */
+  case 0x37: /* PSHB */
+  case 0x38: /* PULX */
+  case 0x39: /* RTS */
+  case 0x3B: /* RTI */
+  case 0x3C: /* PSHX */
+  case 0x8D: /* BSR */
+  case 0x9D: /* JSR */
+  case 0xAD:
+  case 0xBD:
+    return HD6301_GUARD_STACK;
 
-static void op_tpa(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "tpa", NULL);
-  cpu->a = cpu->ccr;
-}
+  case 0x6E: /* JMP, the address is only a target. */
+    return HD6301_GUARD_NONE;
 
-static void op_tst_ext(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "tst", "%02x%02x", mem_read(mem, cpu->pc), mem_read(mem, cpu->pc + 1));
-  address = mem_read(mem, cpu->pc++) * 0x100;
-  address += mem_read(mem, cpu->pc++);
-  value = mem_read(mem, address);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 0;
+  default:
+    if (opcode_info[opcode].mode == HD6301_MODE_IDX ||
+        opcode_info[opcode].mode == HD6301_MODE_IMM_IDX) {
+      return HD6301_GUARD_ADDRESS;
+    }
+    return HD6301_GUARD_NONE;
+  }
 }
 
-static void op_tst_idx(hd6301_t *cpu, mem_t *mem)
+static bool hd6301_jit_static_io(hd6301_decoded_t *decoded)
 {
-  uint8_t value;
-  uint16_t address;
-  hd6301_trace(cpu, "tst", "%02x,x", mem_read(mem, cpu->pc));
-  address = mem_read(mem, cpu->pc++) + cpu->x;
-  value = mem_read(mem, address);
-  cpu->n = (value & 0x80) >> 7;
-  cpu->z = value == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 0;
-}
+  switch (opcode_info[decoded->opcode].mode) {
+  case HD6301_MODE_DIR:
+  case HD6301_MODE_EXT:
+  case HD6301_MODE_IMM_DIR:
+    if (decoded->opcode == 0x7E || /* JMP */
+        decoded->opcode == 0x9D || /* JSR */
+        decoded->opcode == 0xBD) {
+      return false;
+    }
+    return HD6301_JIT_IO(decoded->address);
 
-static void op_tsta(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "tsta", NULL);
-  cpu->n = (cpu->a & 0x80) >> 7;
-  cpu->z = cpu->a == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 0;
+  default:
+    return false;
+  }
 }
 
-static void op_tstb(hd6301_t *cpu, mem_t *mem)
+static bool hd6301_jit_block_end(uint8_t opcode)
 {
-  (void)mem;
-  hd6301_trace(cpu, "tstb", NULL);
-  cpu->n = (cpu->b & 0x80) >> 7;
-  cpu->z = cpu->b == 0 ? 1 : 0;
-  cpu->v = 0;
-  cpu->c = 0;
-}
+  switch (opcode) {
+  case 0x06: /* TAP, may clear I. */
+  case 0x0E: /* CLI */
+  case 0x39: /* RTS */
+  case 0x3B: /* RTI */
+  case 0x6E: /* JMP */
+  case 0x7E:
+  case 0x8D: /* BSR */
+  case 0x9D: /* JSR */
+  case 0xAD:
+  case 0xBD:
+    return true;
 
-static void op_tsx(hd6301_t *cpu, mem_t *mem)
-{
-  (void)mem;
-  hd6301_trace(cpu, "tsx", NULL);
-  cpu->x = cpu->sp + 1;
+  default:
+    return opcode_info[opcode].mode == HD6301_MODE_REL;
+  }
 }
 
-static void op_txs(hd6301_t *cpu, mem_t *mem)
+static bool hd6301_jit_interpreter_only(uint8_t opcode)
 {
-  (void)mem;
-  hd6301_trace(cpu, "txs", NULL);
-  cpu->sp = cpu->x - 1;
-}
+  switch (opcode) {
+  case 0x19: /* DAA */
+  case 0x1A: /* SLP */
+  case 0x3E: /* WAI */
+  case 0x3F: /* SWI */
+    return true;
 
-static void op_wai(hd6301_t *cpu, mem_t *mem)
-{
-  (void)cpu;
-  (void)mem;
-  panic("WAI not implemented!\n");
+  default:
+    return opcode_cycles[opcode] == 0; /* TRAP and unhandled opcodes. */
+  }
 }
 
-static void op_xgdx(hd6301_t *cpu, mem_t *mem)
+/* Translate ROM instructions from PC until a jump, branch or I/O access: */
+static hd6301_block_t *hd6301_jit_translate(hd6301_t *cpu, mem_t *mem,
+  uint16_t pc, const void *handler[])
 {
-  (void)mem;
-  uint16_t temp;
-  hd6301_trace(cpu, "xgdx", NULL);
-  temp = cpu->d;
-  cpu->d = cpu->x;
-  cpu->x = temp;
-}
-
+  hd6301_block_t *block;
+  hd6301_block_op_t *op;
+  hd6301_decoded_t decoded;
+  int used;
 
+  block = &hd6301_block[cpu->id][pc];
+  used = hd6301_block_pool_used[cpu->id];
+  block->op = &hd6301_block_pool[cpu->id][used];
+  block->length = 0;
+  block->cycles = 0;
 
-static void op_trap(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t opcode;
-  opcode = mem_read(mem, cpu->pc - 1);
-  hd6301_trace(cpu, "trap", "%02x", opcode);
-  hd6301_irq(cpu, mem, HD6301_VECTOR_TRAP_LOW, HD6301_VECTOR_TRAP_HIGH);
-}
+  while (block->length < HD6301_JIT_BLOCK_MAX &&
+         used < HD6301_JIT_POOL_SIZE && pc > mem->ram_max) {
+    if (! hd6301_predecode(mem, pc, &decoded, handler)) {
+      break;
+    }
+    if (hd6301_jit_interpreter_only(decoded.opcode) ||
+        hd6301_jit_static_io(&decoded) ||
+        decoded.idle != HD6301_IDLE_NONE) {
+      break;
+    }
 
+    op = &hd6301_block_pool[cpu->id][used];
+    op->handler = decoded.handler;
+    op->operand = decoded.operand;
+    op->address = decoded.address;
+    op->pc      = pc;
+    op->next_pc = decoded.next_pc;
+    op->opcode  = decoded.opcode;
+    op->guard   = hd6301_jit_guard(decoded.opcode);
+    used++;
+
+    block->length++;
+    block->cycles += opcode_cycles[decoded.opcode];
+    pc = decoded.next_pc;
+
+    if (hd6301_jit_block_end(decoded.opcode)) {
+      break;
+    }
+  }
 
+  if (block->length == 0) {
+    block->op = NULL;
+    block->failed = true;
+    return NULL;
+  }
 
-static void op_none(hd6301_t *cpu, mem_t *mem)
-{
+  hd6301_block_pool_used[cpu->id] = used;
+  return block;
+}
+
+static int hd6301_run_threaded(hd6301_t *cpu, mem_t *mem, int cycles)
+{
+#ifdef HD6301_THREADED_GOTO
+  static const void *dispatch[UINT8_MAX + 1] = {
+    HD6301_OPCODE_SPEC(HD6301_THREADED_ADDRESS)
+  };
+  static const void *handler[UINT8_MAX + 1] = {
+    HD6301_OPCODE_SPEC(HD6301_DECODED_ADDRESS)
+  };
+  static const void *block_handler[UINT8_MAX + 1] = {
+    HD6301_OPCODE_SPEC(HD6301_BLOCK_ADDRESS)
+  };
+#else
+  static const void **handler = NULL;
+  static const void **block_handler = NULL;
+#endif /* HD6301_THREADED_GOTO */
+  hd6301_decoded_t *decoded_table;
+  hd6301_decoded_t *decoded = NULL;
+  hd6301_block_t *block_table;
+  hd6301_block_t *block;
+  hd6301_block_op_t *block_op = NULL;
+  hd6301_block_op_t *block_end = NULL;
+  int block_cycles = 0;
+  uint8_t a, b;
+  uint16_t x, sp, pc;
+  uint8_t c, v, z, n, i, h, u;
+  hd6301_lazy_t lazy_op;
+  uint16_t lazy_x = 0, lazy_y = 0, lazy_r = 0;
   uint8_t opcode;
-  opcode = mem_read(mem, cpu->pc - 1);
-  panic("Panic! Unhandled opcode: 0x%02x @ %04x\n", opcode, cpu->pc - 1);
-}
-
+  uint16_t operand = 0;
+  uint16_t address = 0;
+  uint64_t clock_start;
+  int step_cycles;
+  int elapsed = 0;
+  uint16_t idle_pc = 0; /* Branch of the poll loop seen last, or 0. */
+  int idle_elapsed = 0;
+  uint8_t idle_a = 0, idle_b = 0, idle_ccr = 0;
+  uint16_t idle_x = 0, idle_sp = 0;
+  int idle_skip;
+
+  decoded_table = hd6301_decoded[cpu->id];
+  block_table = hd6301_block[cpu->id];
+  HD6301_RELOAD()
+
+step:
+  if (elapsed >= cycles || cpu->sync_event) {
+    goto done;
+  }
+  if (HD6301_ATTENTION) {
+    goto attention;
+  }
 
+fetch:
+  HD6301_THREADED_FETCH()
 
-typedef void (*hd6301_operation_func_t)(hd6301_t *, mem_t *);
+jit:
+  block = &block_table[pc];
+  if (block->op == NULL) {
+    if (block->hits < HD6301_JIT_THRESHOLD) {
+      block->hits++;
+      goto rom;
+    }
+    if (block->failed || hd6301_jit_translate(cpu, mem, pc,
+      block_handler) == NULL) {
+      goto rom;
+    }
+  }
 
-static hd6301_operation_func_t opcode_function[UINT8_MAX + 1] = {
-  op_trap,     op_nop,      op_none,     op_none,     /* 0x00 -> 0x03 */
-  op_lsrd,     op_asld,     op_tap,      op_tpa,      /* 0x04 -> 0x07 */
-  op_inx,      op_dex,      op_clv,      op_sev,      /* 0x08 -> 0x0B */
-  op_clc,      op_sec,      op_cli,      op_sei,      /* 0x0C -> 0x0F */
-  op_sba,      op_cba,      op_none,     op_none,     /* 0x10 -> 0x13 */
-  op_none,     op_none,     op_tab,      op_tba,      /* 0x14 -> 0x17 */
-  op_xgdx,     op_daa,      op_slp,      op_aba,      /* 0x18 -> 0x1B */
-  op_none,     op_none,     op_none,     op_none,     /* 0x1C -> 0x1F */
-  op_bra,      op_brn,      op_bhi,      op_bls,      /* 0x20 -> 0x23 */
-  op_bcc,      op_bcs,      op_bne,      op_beq,      /* 0x24 -> 0x27 */
-  op_bvc,      op_bvs,      op_bpl,      op_bmi,      /* 0x28 -> 0x2B */
-  op_bge,      op_blt,      op_bgt,      op_ble,      /* 0x2C -> 0x2F */
-  op_tsx,      op_ins,      op_pula,     op_pulb,     /* 0x30 -> 0x33 */
-  op_des,      op_txs,      op_psha,     op_pshb,     /* 0x34 -> 0x37 */
-  op_pulx,     op_rts,      op_abx,      op_rti,      /* 0x38 -> 0x3B */
-  op_pshx,     op_mul,      op_wai,      op_swi,      /* 0x3C -> 0x3F */
-  op_nega,     op_none,     op_none,     op_coma,     /* 0x40 -> 0x43 */
-  op_lsra,     op_none,     op_rora,     op_asra,     /* 0x44 -> 0x47 */
-  op_asla,     op_rola,     op_deca,     op_none,     /* 0x48 -> 0x4B */
-  op_inca,     op_tsta,     op_none,     op_clra,     /* 0x4C -> 0x4F */
-  op_negb,     op_none,     op_none,     op_comb,     /* 0x50 -> 0x53 */
-  op_lsrb,     op_none,     op_rorb,     op_asrb,     /* 0x54 -> 0x57 */
-  op_aslb,     op_rolb,     op_decb,     op_none,     /* 0x58 -> 0x5B */
-  op_incb,     op_tstb,     op_none,     op_clrb,     /* 0x5C -> 0x5F */
-  op_neg_idx,  op_aim_idx,  op_oim_idx,  op_com_idx,  /* 0x60 -> 0x63 */
-  op_lsr_idx,  op_eim_idx,  op_ror_idx,  op_asr_idx,  /* 0x64 -> 0x67 */
-  op_asl_idx,  op_rol_idx,  op_dec_idx,  op_tim_idx,  /* 0x68 -> 0x6B */
-  op_inc_idx,  op_tst_idx,  op_jmp_idx,  op_clr_idx,  /* 0x6C -> 0x6F */
-  op_neg_ext,  op_aim_dir,  op_oim_dir,  op_com_ext,  /* 0x70 -> 0x73 */
-  op_lsr_ext,  op_eim_dir,  op_ror_ext,  op_asr_ext,  /* 0x74 -> 0x77 */
-  op_asl_ext,  op_rol_ext,  op_dec_ext,  op_tim_dir,  /* 0x78 -> 0x7B */
-  op_inc_ext,  op_tst_ext,  op_jmp_ext,  op_clr_ext,  /* 0x7C -> 0x7F */
-  op_suba_imm, op_cmpa_imm, op_sbca_imm, op_subd_imm, /* 0x80 -> 0x83 */
-  op_anda_imm, op_bita_imm, op_ldaa_imm, op_none,     /* 0x84 -> 0x87 */
-  op_eora_imm, op_adca_imm, op_oraa_imm, op_adda_imm, /* 0x88 -> 0x8B */
-  op_cpx_imm,  op_bsr,      op_lds_imm,  op_none,     /* 0x8C -> 0x8F */
-  op_suba_dir, op_cmpa_dir, op_sbca_dir, op_subd_dir, /* 0x90 -> 0x93 */
-  op_anda_dir, op_bita_dir, op_ldaa_dir, op_staa_dir, /* 0x94 -> 0x97 */
-  op_eora_dir, op_adca_dir, op_oraa_dir, op_adda_dir, /* 0x98 -> 0x9B */
-  op_cpx_dir,  op_jsr_dir,  op_lds_dir,  op_sts_dir,  /* 0x9C -> 0x9F */
-  op_suba_idx, op_cmpa_idx, op_sbca_idx, op_subd_idx, /* 0xA0 -> 0xA3 */
-  op_anda_idx, op_bita_idx, op_ldaa_idx, op_staa_idx, /* 0xA4 -> 0xA7 */
-  op_eora_idx, op_adca_idx, op_oraa_idx, op_adda_idx, /* 0xA8 -> 0xAB */
-  op_cpx_idx,  op_jsr_idx,  op_lds_idx,  op_sts_idx,  /* 0xAC -> 0xAF */
-  op_suba_ext, op_cmpa_ext, op_sbca_ext, op_subd_ext, /* 0xB0 -> 0xB3 */
-  op_anda_ext, op_bita_ext, op_ldaa_ext, op_staa_ext, /* 0xB4 -> 0xB7 */
-  op_eora_ext, op_adca_ext, op_oraa_ext, op_adda_ext, /* 0xB8 -> 0xBB */
-  op_cpx_ext,  op_jsr_ext,  op_lds_ext,  op_sts_ext,  /* 0xBC -> 0xBF */
-  op_subb_imm, op_cmpb_imm, op_sbcb_imm, op_addd_imm, /* 0xC0 -> 0xC3 */
-  op_andb_imm, op_bitb_imm, op_ldab_imm, op_none,     /* 0xC4 -> 0xC7 */
-  op_eorb_imm, op_adcb_imm, op_orab_imm, op_addb_imm, /* 0xC8 -> 0xCB */
-  op_ldd_imm,  op_none,     op_ldx_imm,  op_none,     /* 0xCC -> 0xCF */
-  op_subb_dir, op_cmpb_dir, op_sbcb_dir, op_addd_dir, /* 0xD0 -> 0xD3 */
-  op_andb_dir, op_bitb_dir, op_ldab_dir, op_stab_dir, /* 0xD4 -> 0xD7 */
-  op_eorb_dir, op_adcb_dir, op_orab_dir, op_addb_dir, /* 0xD8 -> 0xDB */
-  op_ldd_dir,  op_std_dir,  op_ldx_dir,  op_stx_dir,  /* 0xDC -> 0xDF */
-  op_subb_idx, op_cmpb_idx, op_sbcb_idx, op_addd_idx, /* 0xE0 -> 0xE3 */
-  op_andb_idx, op_bitb_idx, op_ldab_idx, op_stab_idx, /* 0xE4 -> 0xE7 */
-  op_eorb_idx, op_adcb_idx, op_orab_idx, op_addb_idx, /* 0xE8 -> 0xEB */
-  op_ldd_idx,  op_std_idx,  op_ldx_idx,  op_stx_idx,  /* 0xEC -> 0xEF */
-  op_subb_ext, op_cmpb_ext, op_sbcb_ext, op_addd_ext, /* 0xF0 -> 0xF3 */
-  op_andb_ext, op_bitb_ext, op_ldab_ext, op_stab_ext, /* 0xF4 -> 0xF7 */
-  op_eorb_ext, op_adcb_ext, op_orab_ext, op_addb_ext, /* 0xF8 -> 0xFB */
-  op_ldd_ext,  op_std_ext,  op_ldx_ext,  op_stx_ext,  /* 0xFC -> 0xFF */
-};
+  /* Run the whole block only if it stays within budget, before OCR and
+     with no housekeeping due from changes made outside of the CPU: */
+  if (elapsed + block->cycles > cycles ||
+    (uint16_t)(cpu->timer_event - cpu->counter) < block->cycles ||
+    (cpu->pending & HD6301_PENDING_HOUSEKEEPING)) {
+    goto rom;
+  }
+  block_op = block->op;
+  block_end = block->op + block->length;
+  block_cycles = 0;
+#ifdef HD6301_THREADED_GOTO
+  goto *block_op->handler;
+#else
+block_dispatch:
+  if (block_op == block_end) {
+    goto block_done;
+  }
+  switch (block_op->opcode) {
+  HD6301_OPCODE_SPEC(HD6301_BLOCK_CASE)
+  }
+#endif /* HD6301_THREADED_GOTO */
 
+  HD6301_OPCODE_SPEC(HD6301_BLOCK_BODY)
 
+block_exit:
+  /* Guard failed, so leave this instruction to the interpreter: */
+  pc = block_op->pc;
+  HD6301_BLOCK_COUNTER_INCREMENT()
+  goto rom;
 
-static int opcode_cycles[UINT8_MAX + 1] = {
-/*
-  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
-*/
-  0, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, /* 0x00 -> 0x0F */
-  1, 1, 0, 0, 0, 0, 1, 1, 2, 2, 4, 1, 0, 0, 0, 0, /* 0x10 -> 0x1F */
-  3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, /* 0x20 -> 0x2F */
-  1, 1, 3, 3, 1, 1, 4, 4, 4, 5, 1,10, 5, 7, 9,12, /* 0x30 -> 0x3F */
-  1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, /* 0x40 -> 0x4F */
-  1, 0, 0, 1, 1, 0, 1, 1, 1, 1, 1, 0, 1, 1, 0, 1, /* 0x50 -> 0x5F */
-  6, 7, 7, 6, 6, 7, 6, 6, 6, 6, 6, 5, 6, 4, 3, 5, /* 0x60 -> 0x6F */
-  6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 4, 6, 4, 3, 5, /* 0x70 -> 0x7F */
-  2, 2, 2, 3, 2, 2, 2, 0, 2, 2, 2, 2, 3, 5, 3, 0, /* 0x80 -> 0x8F */
-  3, 3, 3, 4, 3, 3, 3, 3, 3, 3, 3, 3, 4, 5, 4, 4, /* 0x90 -> 0x9F */
-  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xA0 -> 0xAF */
-  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 6, 5, 5, /* 0xB0 -> 0xBF */
-  2, 2, 2, 3, 2, 2, 2, 0, 2, 2, 2, 2, 3, 0, 3, 0, /* 0xC0 -> 0xCF */
-  3, 3, 3, 4, 3, 3, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, /* 0xD0 -> 0xDF */
-  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xE0 -> 0xEF */
-  4, 4, 4, 5, 4, 4, 4, 4, 4, 4, 4, 4, 5, 5, 5, 5, /* 0xF0 -> 0xFF */
-};
+block_done:
+  HD6301_BLOCK_COUNTER_INCREMENT()
+  goto step;
 
+rom:
+  decoded = &decoded_table[pc];
+  if (! decoded->valid) {
+    goto predecode;
+  }
+  HD6301_DECODED()
 
+predecode:
+  if (hd6301_predecode(mem, pc, decoded, handler)) {
+#ifdef HD6301_THREADED_GOTO
+    if (decoded->idle != HD6301_IDLE_NONE) {
+      decoded->handler = &&idle;
+    }
+#endif /* HD6301_THREADED_GOTO */
+    HD6301_DECODED()
+  }
+  opcode = mem_read(mem, pc++);
+  HD6301_THREADED_DISPATCH()
+
+idle:
+  /* At the branch of a loop, skip whole iterations that would end before
+     the budget runs out or the OCR matches: */
+  idle_skip = cycles - elapsed - 1;
+  if ((uint16_t)(cpu->timer_event - cpu->counter) < idle_skip) {
+    idle_skip = (uint16_t)(cpu->timer_event - cpu->counter);
+  }
+  idle_skip /= decoded->idle_cycles;
+  if (cpu->pending & HD6301_PENDING_HOUSEKEEPING) {
+    idle_skip = 0; /* Housekeeping is due first. */
+  }
 
-static void hd6301_counter_increment(hd6301_t *cpu, mem_t *mem, int cycles)
-{
-  uint16_t prev_counter;
-  uint16_t ocr;
+  switch (decoded->idle) {
+  case HD6301_IDLE_POLL:
+    /* Repeats only once an iteration with nothing else going on has left
+       the same state, and the branch is taken again: */
+    if (idle_pc != decoded - decoded_table ||
+        elapsed - idle_elapsed != decoded->idle_cycles ||
+        a != idle_a || b != idle_b || x != idle_x || sp != idle_sp ||
+        HD6301_CCR != idle_ccr ||
+        ! hd6301_idle_taken(decoded->opcode, idle_ccr)) {
+      idle_skip = 0;
+    }
+    break;
 
-  cpu->sync_counter += cycles;
+  case HD6301_IDLE_DEX:
+    if (HD6301_FLAG_Z == 1) {
+      idle_skip = 0; /* Leaving the loop. */
+    } else if (idle_skip > (uint16_t)(x - 1)) {
+      idle_skip = (uint16_t)(x - 1);
+    }
+    x -= idle_skip;
+    break;
 
-  prev_counter = cpu->counter;
-  cpu->counter += cycles;
-  mem->ram[HD6301_REG_FRC_HIGH] = cpu->counter / 0x100;
-  mem->ram[HD6301_REG_FRC_LOW]  = cpu->counter % 0x100;
-
-  /* Output compare: */
-  ocr = mem->ram[HD6301_REG_OCR_LOW] + (mem->ram[HD6301_REG_OCR_HIGH] * 0x100);
-  while (cycles > 0) {
-    if (prev_counter == ocr) {
-      mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_OCF);
-      /* Generate IRQ if enabled: */
-      if ((mem->ram[HD6301_REG_TCSR] >> HD6301_TCSR_EOCI) & 1) {
-        hd6301_irq(cpu, mem, HD6301_VECTOR_OCF_LOW, HD6301_VECTOR_OCF_HIGH);
-      }
+  case HD6301_IDLE_DECA:
+    if (HD6301_FLAG_Z == 1) {
+      idle_skip = 0;
+    } else if (idle_skip > (uint8_t)(a - 1)) {
+      idle_skip = (uint8_t)(a - 1);
+    }
+    if (idle_skip > 0) {
+      a -= idle_skip;
+      HD6301_LAZY(HD6301_LAZY_DEC8, 0, 0, a)
+    }
+    break;
 
-      /* Set P21 based on OLVL as used by RS232C: */
-      if (mem->ram[HD6301_REG_TCSR] & 1) {
-        mem->ram[HD6301_REG_PORT_2] |= 0x02;
-      } else {
-        mem->ram[HD6301_REG_PORT_2] &= ~0x02;
-      }
-      cpu->p21_set = true;
+  case HD6301_IDLE_DECB:
+    if (HD6301_FLAG_Z == 1) {
+      idle_skip = 0;
+    } else if (idle_skip > (uint8_t)(b - 1)) {
+      idle_skip = (uint8_t)(b - 1);
     }
-    prev_counter++;
-    cycles--;
+    if (idle_skip > 0) {
+      b -= idle_skip;
+      HD6301_LAZY(HD6301_LAZY_DEC8, 0, 0, b)
+    }
+    break;
+
+  default:
+    idle_skip = 0;
+    break;
+  }
+
+  if (idle_skip > 0) {
+    idle_skip *= decoded->idle_cycles;
+    cpu->counter += idle_skip;
+    cpu->clock += idle_skip;
+    elapsed += idle_skip;
+    cpu->idle_skipped += idle_skip;
   }
-}
 
+  idle_pc = decoded - decoded_table;
+  idle_elapsed = elapsed;
+  idle_a = a;
+  idle_b = b;
+  idle_x = x;
+  idle_sp = sp;
+  idle_ccr = HD6301_CCR;
+  HD6301_IDLE_RESUME()
+
+#ifndef HD6301_THREADED_GOTO
+dispatch_decoded:
+  switch (opcode) {
+  HD6301_OPCODE_SPEC(HD6301_DECODED_CASE)
+  }
 
+dispatch:
+  switch (opcode) {
+#endif /* HD6301_THREADED_GOTO */
 
-void hd6301_execute(hd6301_t *cpu, mem_t *mem)
-{
-  uint8_t opcode;
+  HD6301_OPCODE_SPEC(HD6301_THREADED_BODY)
 
-  /* Pester CPU with SCI IRQ if there are still unread RDR contents: */
-  if ((mem->ram[HD6301_REG_TRCSR] >> HD6301_TRCSR_RDRF) & 1) {
-    if ((mem->ram[HD6301_REG_TRCSR] >> HD6301_TRCSR_RIE) & 1) {
-      hd6301_irq(cpu, mem, HD6301_VECTOR_SCI_LOW, HD6301_VECTOR_SCI_HIGH);
-    }
+#ifndef HD6301_THREADED_GOTO
   }
+#endif /* HD6301_THREADED_GOTO */
 
-  if (cpu->sleep) {
-    hd6301_counter_increment(cpu, mem, 1);
-    return;
+counter_slow:
+  HD6301_COUNTER_INCREMENT(step_cycles)
+
+housekeeping:
+  hd6301_housekeeping(cpu, mem);
+  idle_pc = 0; /* Memory may have changed. */
+  goto step;
+
+attention:
+  if (hd6301_sci_irq_due(cpu, mem)) {
+    HD6301_IRQ(HD6301_VECTOR_SCI_LOW, HD6301_VECTOR_SCI_HIGH)
+  }
+
+  if (cpu->sleep || cpu->wait) {
+    HD6301_COUNTER_INCREMENT(hd6301_sleep_cycles(cpu, cycles - elapsed))
+    goto step;
   }
 
   /* Check for pending IRQ: */
-  if (cpu->irq_pending && (cpu->i == 0)) {
-    hd6301_irq(cpu, mem,
-      cpu->irq_pending_vector_low,
-      cpu->irq_pending_vector_high);
+  if (cpu->irq_pending && (i == 0)) {
+    HD6301_IRQ(cpu->irq_pending_vector_low, cpu->irq_pending_vector_high)
     cpu->irq_pending = false;
     cpu->irq_pending_vector_low  = 0x0;
     cpu->irq_pending_vector_high = 0x0;
   }
+  goto fetch;
 
-  opcode = mem_read(mem, cpu->pc++);
-  (opcode_function[opcode])(cpu, mem);
+done:
+  HD6301_SPILL()
+  return elapsed;
+}
 
-  hd6301_counter_increment(cpu, mem, opcode_cycles[opcode]);
 
-  /* RDRF clear: */
-  if (cpu->rdr_flag) {
-    mem->ram[HD6301_REG_TRCSR] &= ~(1 << HD6301_TRCSR_RDRF);
-    cpu->rdr_flag = false;
+
+void hd6301_core_select(hd6301_core_t core)
+{
+  hd6301_core = core;
+}
+
+
+
+void hd6301_jit_enable(bool enable)
+{
+  hd6301_jit_active = enable;
+}
+
+
+
+int hd6301_run(hd6301_t *cpu, mem_t *mem, int cycles)
+{
+  uint64_t clock_start;
+  int elapsed;
+
+  /* Stop early when the other MCU or a peripheral must see an output: */
+  cpu->sync_event = false;
+
+  if (hd6301_core == HD6301_CORE_THREADED && ! hd6301_trace_active) {
+    return hd6301_run_threaded(cpu, mem, cycles);
   }
 
-  /* Check for P20 input change and possibly ICR transfer: */
-  if ((mem->ram[HD6301_REG_PORT_2] & 1) != cpu->p20_prev) {
-    if ((mem->ram[HD6301_REG_TCSR] >> HD6301_TCSR_IEDG) & 1) {
-      /* Low to High transition. */
-      if (cpu->p20_prev == false) {
-        mem->ram[HD6301_REG_ICR_HIGH] = cpu->counter / 0x100;
-        mem->ram[HD6301_REG_ICR_LOW]  = cpu->counter % 0x100;
-        mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_ICF);
-      }
+  /* Table core, also used whenever tracing is active: */
+  elapsed = 0;
+  while (elapsed < cycles) {
+    clock_start = cpu->clock;
+    if ((cpu->sleep || cpu->wait) && ! hd6301_sci_irq_due(cpu, mem)) {
+      hd6301_counter_increment(cpu, mem,
+        hd6301_sleep_cycles(cpu, cycles - elapsed));
     } else {
-      /* High to Low transition. */
-      if (cpu->p20_prev == true) {
-        mem->ram[HD6301_REG_ICR_HIGH] = cpu->counter / 0x100;
-        mem->ram[HD6301_REG_ICR_LOW]  = cpu->counter % 0x100;
-        mem->ram[HD6301_REG_TCSR] |= (1 << HD6301_TCSR_ICF);
-      }
+      hd6301_execute(cpu, mem);
     }
-    cpu->p20_prev = mem->ram[HD6301_REG_PORT_2] & 1;
+    elapsed += cpu->clock - clock_start;
+    if (cpu->sync_event) {
+      break;
+    }
+  }
+  return elapsed;
+}
+
+
+
+/* Cycles a sleeping or waiting CPU can be run before it may wake up by
+   itself, or 0 if it is running or has an interrupt to take: */
+int hd6301_halted_cycles(hd6301_t *cpu, mem_t *mem)
+{
+  if (! (cpu->sleep || cpu->wait)) {
+    return 0;
+  }
+
+  if (hd6301_sci_irq_due(cpu, mem)) {
+    return 0;
+  }
+
+  if (cpu->irq_pending && (cpu->i == 0)) {
+    return 0;
   }
+
+  return hd6301_ocr_cycles(cpu);
 }
 
 
@@ -3262,34 +2224,71 @@ void hd6301_reset(hd6301_t *cpu, mem_t *mem, int id)
   cpu->ccr = 0xD0;
 
   cpu->counter = 0;
-  cpu->sync_counter = 0;
+  cpu->icr = 0;
+  cpu->frc_low_latch = -1;
+  cpu->idle_skipped = 0;
+  cpu->instructions = 0;
 
   cpu->tcsr_ocf_flag   = false;
   cpu->tcsr_icf_flag   = false;
   cpu->trcsr_orfe_flag = false;
   cpu->trcsr_rdrf_flag = false;
-  cpu->rdr_flag        = false;
 
+  cpu->pending = HD6301_PENDING_P20; /* P20 may already be high. */
   cpu->p20_prev = false;
+  cpu->sync_event = false;
 
   cpu->transmit_shift_register = -1;
   cpu->sleep = false;
+  cpu->wait = false;
 
   cpu->irq_pending = false;
   cpu->irq_pending_vector_low  = 0x0;
   cpu->irq_pending_vector_high = 0x0;
 
+  /* ROM contents are only loaded before reset, so decode them again: */
+  for (int i = 0; i <= UINT16_MAX; i++) {
+    hd6301_decoded[id][i].valid = false;
+    hd6301_block[id][i].op = NULL;
+    hd6301_block[id][i].hits = 0;
+    hd6301_block[id][i].failed = false;
+  }
+  hd6301_block_pool_used[id] = 0;
+
   mem->ram[HD6301_REG_OCR_HIGH] = 0xFF;
   mem->ram[HD6301_REG_OCR_LOW]  = 0xFF;
+  cpu->timer_event = 0xFFFF;
   mem->ram[HD6301_REG_TCSR]     = 0x00;
   mem->ram[HD6301_REG_TRCSR]    = 0x20;
 }
 
 
 
+/* Only connected pins that changed call out, others cost nothing: */
+static void hd6301_pin_edges(hd6301_t *cpu, int port,
+  uint8_t previous, uint8_t value)
+{
+  uint8_t changed;
+
+  changed = (previous ^ value) & cpu->pin_mask[port];
+  if (changed == 0) {
+    return;
+  }
+
+  for (int i = 0; i < cpu->pins; i++) {
+    if (cpu->pin[i].port == port && (cpu->pin[i].mask & changed)) {
+      (cpu->pin[i].edge)(cpu, value);
+    }
+  }
+}
+
+
+
 void hd6301_register_write(hd6301_t *cpu, mem_t *mem, 
   uint16_t address, uint8_t value)
 {
+  uint8_t previous;
+
   switch (address) {
   case HD6301_REG_TCSR:
     mem->ram[address] = (mem->ram[address] & 0b11100000) + (value & 0b11111);
@@ -3297,6 +2296,7 @@ void hd6301_register_write(hd6301_t *cpu, mem_t *mem,
 
   case HD6301_REG_TRCSR:
     mem->ram[address] = (mem->ram[address] & 0b11100000) + (value & 0b11111);
+    cpu->pending |= HD6301_PENDING_SCI_IRQ; /* RIE may have been set. */
     break;
 
   case HD6301_REG_OCR_LOW:
@@ -3306,33 +2306,50 @@ void hd6301_register_write(hd6301_t *cpu, mem_t *mem,
       cpu->tcsr_ocf_flag = false;
     }
     mem->ram[address] = value;
+    cpu->timer_event = mem->ram[HD6301_REG_OCR_LOW] +
+      (mem->ram[HD6301_REG_OCR_HIGH] * 0x100);
     break;
 
   case HD6301_REG_TDR:
-    /* HD6301_TRCSR_TDRE not manipulated since this happens instantly. */
+    /* TDRE is set again once the byte has been taken by the other end: */
     mem->ram[address] = value;
+    mem->ram[HD6301_REG_TRCSR] &= ~(1 << HD6301_TRCSR_TDRE);
     cpu->transmit_shift_register = value;
+    cpu->sync_event = true;
     break;
 
   case HD6301_REG_PORT_1:
     /* Filter value based on data direction, don't write to inputs. */
+    previous = mem->ram[HD6301_REG_PORT_1];
     mem->ram[HD6301_REG_PORT_1] &= ~mem->ram[HD6301_REG_DDR_1];
     mem->ram[HD6301_REG_PORT_1] |= value;
+    hd6301_pin_edges(cpu, 1, previous, mem->ram[HD6301_REG_PORT_1]);
+    cpu->sync_event = true;
     break;
 
   case HD6301_REG_PORT_2:
+    previous = mem->ram[HD6301_REG_PORT_2];
     mem->ram[HD6301_REG_PORT_2] &= ~mem->ram[HD6301_REG_DDR_2];
     mem->ram[HD6301_REG_PORT_2] |= value;
+    hd6301_pin_edges(cpu, 2, previous, mem->ram[HD6301_REG_PORT_2]);
+    cpu->pending |= HD6301_PENDING_P20;
+    cpu->sync_event = true;
     break;
 
   case HD6301_REG_PORT_3:
+    previous = mem->ram[HD6301_REG_PORT_3];
     mem->ram[HD6301_REG_PORT_3] &= ~mem->ram[HD6301_REG_DDR_3];
     mem->ram[HD6301_REG_PORT_3] |= value;
+    hd6301_pin_edges(cpu, 3, previous, mem->ram[HD6301_REG_PORT_3]);
+    cpu->sync_event = true;
     break;
 
   case HD6301_REG_PORT_4:
+    previous = mem->ram[HD6301_REG_PORT_4];
     mem->ram[HD6301_REG_PORT_4] &= ~mem->ram[HD6301_REG_DDR_4];
     mem->ram[HD6301_REG_PORT_4] |= value;
+    hd6301_pin_edges(cpu, 4, previous, mem->ram[HD6301_REG_PORT_4]);
+    cpu->sync_event = true;
     break;
 
   default:
@@ -3351,7 +2368,28 @@ void hd6301_register_read_notify(hd6301_t *cpu, mem_t *mem, uint16_t address)
     cpu->tcsr_icf_flag = true;
     break;
 
+  /* The counter and capture registers are only stored when read. Reading
+     the MSB latches the LSB, so a 16-bit read gives a consistent value: */
+  case HD6301_REG_FRC_HIGH:
+    mem->ram[HD6301_REG_FRC_HIGH] = cpu->counter / 0x100;
+    cpu->frc_low_latch = cpu->counter % 0x100;
+    break;
+
+  case HD6301_REG_FRC_LOW:
+    if (cpu->frc_low_latch >= 0) {
+      mem->ram[HD6301_REG_FRC_LOW] = cpu->frc_low_latch;
+      cpu->frc_low_latch = -1;
+    } else {
+      mem->ram[HD6301_REG_FRC_LOW] = cpu->counter % 0x100;
+    }
+    break;
+
+  case HD6301_REG_ICR_LOW:
+    mem->ram[HD6301_REG_ICR_LOW] = cpu->icr % 0x100;
+    break;
+
   case HD6301_REG_ICR_HIGH:
+    mem->ram[HD6301_REG_ICR_HIGH] = cpu->icr / 0x100;
     if (cpu->tcsr_icf_flag) {
       mem->ram[HD6301_REG_TCSR] &= ~(1 << HD6301_TCSR_ICF);
       cpu->tcsr_icf_flag = false;
@@ -3365,7 +2403,7 @@ void hd6301_register_read_notify(hd6301_t *cpu, mem_t *mem, uint16_t address)
 
   case HD6301_REG_RDR:
     if (cpu->trcsr_rdrf_flag) {
-      cpu->rdr_flag = true;
+      cpu->pending |= HD6301_PENDING_RDRF_CLEAR;
       cpu->trcsr_rdrf_flag = false;
     }
     break;
@@ -3377,6 +2415,8 @@ void hd6301_register_read_notify(hd6301_t *cpu, mem_t *mem, uint16_t address)
 void hd6301_irq(hd6301_t *cpu, mem_t *mem,
   uint16_t vector_low, uint16_t vector_high)
 {
+  int cycles;
+
   cpu->sleep = false; /* Always taken out of sleep. */
 
   if (cpu->i) {
@@ -3386,28 +2426,37 @@ void hd6301_irq(hd6301_t *cpu, mem_t *mem,
       cpu->irq_pending_vector_low  = vector_low;
       cpu->irq_pending_vector_high = vector_high;
       cpu->irq_pending = true;
-      hd6301_trace(cpu, NULL, "IRQ pending %04x:%04x", vector_low, vector_high);
+      hd6301_trace_irq(cpu, HD6301_TRACE_IRQ_PENDING,
+        vector_low, vector_high);
       return;
     } else {
       /* ...while others are neglected. */
-      hd6301_trace(cpu, NULL, "IRQ ignored %04x:%04x", vector_low, vector_high);
+      hd6301_trace_irq(cpu, HD6301_TRACE_IRQ_IGNORED,
+        vector_low, vector_high);
       return;
     }
   }
 
-  hd6301_trace(cpu, NULL, "IRQ execute %04x:%04x", vector_low, vector_high);
-
-  mem_write(mem, cpu->sp--, cpu->pc % 0x100);
-  mem_write(mem, cpu->sp--, cpu->pc / 0x100);
-  mem_write(mem, cpu->sp--, cpu->x % 0x100);
-  mem_write(mem, cpu->sp--, cpu->x / 0x100);
-  mem_write(mem, cpu->sp--, cpu->a);
-  mem_write(mem, cpu->sp--, cpu->b);
-  mem_write(mem, cpu->sp--, cpu->ccr);
+  hd6301_trace_irq(cpu, HD6301_TRACE_IRQ_EXECUTE, vector_low, vector_high);
+
+  if (cpu->wait) {
+    /* State was already stacked by WAI, so skip those 7 cycles: */
+    cpu->wait = false;
+    cycles = 5;
+  } else {
+    mem_write(mem, cpu->sp--, cpu->pc % 0x100);
+    mem_write(mem, cpu->sp--, cpu->pc / 0x100);
+    mem_write(mem, cpu->sp--, cpu->x % 0x100);
+    mem_write(mem, cpu->sp--, cpu->x / 0x100);
+    mem_write(mem, cpu->sp--, cpu->a);
+    mem_write(mem, cpu->sp--, cpu->b);
+    mem_write(mem, cpu->sp--, cpu->ccr);
+    cycles = 12;
+  }
   cpu->i = 1;
   cpu->pc  = mem_read(mem, vector_low);
   cpu->pc += mem_read(mem, vector_high) * 0x100;
-  hd6301_counter_increment(cpu, mem, 12);
+  hd6301_counter_increment(cpu, mem, cycles);
 }
 
 
@@ -3416,6 +2465,7 @@ void hd6301_sci_receive(hd6301_t *cpu, mem_t *mem, uint8_t value)
 {
   mem->ram[HD6301_REG_RDR] = value;
   mem->ram[HD6301_REG_TRCSR] |= (1 << HD6301_TRCSR_RDRF);
+  cpu->pending |= HD6301_PENDING_SCI_IRQ;
   if ((mem->ram[HD6301_REG_TRCSR] >> HD6301_TRCSR_RIE) & 1) {
     hd6301_irq(cpu, mem, HD6301_VECTOR_SCI_LOW, HD6301_VECTOR_SCI_HIGH);
   }
@@ -3423,3 +2473,43 @@ void hd6301_sci_receive(hd6301_t *cpu, mem_t *mem, uint8_t value)
 
 
 
+/* The transmitted byte has left, so TDR is empty again: */
+void hd6301_sci_transmitted(hd6301_t *cpu, mem_t *mem)
+{
+  cpu->transmit_shift_register = -1;
+  mem->ram[HD6301_REG_TRCSR] |= (1 << HD6301_TRCSR_TDRE);
+}
+
+
+
+/* Wire output pins of a port to a consumer, called on their edges: */
+void hd6301_pin_connect(hd6301_t *cpu, int port, uint8_t mask,
+  hd6301_pin_edge_t edge)
+{
+  if (cpu->pins >= HD6301_PINS_MAX) {
+    panic("Too many pins connected on MCU #%d\n", cpu->id);
+    return;
+  }
+
+  cpu->pin[cpu->pins].port = port;
+  cpu->pin[cpu->pins].mask = mask;
+  cpu->pin[cpu->pins].edge = edge;
+  cpu->pins++;
+  cpu->pin_mask[port] |= mask;
+}
+
+
+
+/* Drive the P20 input pin from the outside, input capture follows: */
+void hd6301_p20_input(hd6301_t *cpu, mem_t *mem, bool level)
+{
+  if (level) {
+    mem->ram[HD6301_REG_PORT_2] |= 1;
+  } else {
+    mem->ram[HD6301_REG_PORT_2] &= ~1;
+  }
+  cpu->pending |= HD6301_PENDING_P20;
+}
+
+
+
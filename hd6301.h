@@ -6,6 +6,20 @@
 #include <stdio.h> /* FILE */
 #include "mem.h"
 
+#define HD6301_PORTS    4 /* Ports 1 to 4. */
+#define HD6301_PINS_MAX 8 /* Connections in the netlist of each MCU. */
+
+struct hd6301_s;
+
+/* Called with the new port value when a connected output pin changes: */
+typedef void (*hd6301_pin_edge_t)(struct hd6301_s *cpu, uint8_t value);
+
+typedef struct hd6301_pin_s {
+  int port;
+  uint8_t mask; /* Pins on the port. */
+  hd6301_pin_edge_t edge;
+} hd6301_pin_t;
+
 typedef struct hd6301_s {
   union {
     struct {
@@ -32,7 +46,12 @@ typedef struct hd6301_s {
   };
 
   uint16_t counter; /* Free Running Counter */
-  uint16_t sync_counter; /* Extra counter for synchronization. */
+  uint64_t clock; /* Cycles run, never reset. Time base for peripherals. */
+  uint16_t timer_event; /* Counter value of next output compare match. */
+  uint16_t icr; /* Counter value captured on the last P20 edge. */
+  int frc_low_latch; /* Counter LSB latched by reading the MSB, or -1. */
+  unsigned long idle_skipped; /* Cycles skipped in idle loops. */
+  unsigned long instructions; /* Executed by the table core. */
   int id; /* Identification (used in trace) */
 
   /* Flags used for read notification then clearing: */
@@ -40,19 +59,34 @@ typedef struct hd6301_s {
   bool tcsr_icf_flag;
   bool trcsr_orfe_flag;
   bool trcsr_rdrf_flag;
-  bool rdr_flag;
 
+  uint8_t pending; /* HD6301_PENDING_* work due before next instruction. */
   bool p20_prev; /* Previous state of P20 input pin. */
   bool p21_set; /* To easily track that P21 output pin has changed. */
+  bool sync_event; /* Output seen by others, so hd6301_run() returns. */
 
   int transmit_shift_register;
   bool sleep;
+  bool wait; /* State stacked by WAI, waiting for an interrupt. */
 
   bool irq_pending;
   uint16_t irq_pending_vector_low;
   uint16_t irq_pending_vector_high;
+
+  /* Netlist of output pins, not touched by reset: */
+  hd6301_pin_t pin[HD6301_PINS_MAX];
+  int pins;
+  uint8_t pin_mask[HD6301_PORTS + 1]; /* Connected pins on each port. */
 } hd6301_t;
 
+#define HD6301_PENDING_SCI_IRQ    0x01 /* RDRF and RIE may both be set. */
+#define HD6301_PENDING_RDRF_CLEAR 0x02 /* RDR read after TRCSR, clear RDRF. */
+#define HD6301_PENDING_P20        0x04 /* Port 2 changed, check P20 edge. */
+
+/* Pending work handled by hd6301_housekeeping() after an instruction: */
+#define HD6301_PENDING_HOUSEKEEPING \
+  (HD6301_PENDING_RDRF_CLEAR | HD6301_PENDING_P20)
+
 #define HD6301_VECTOR_TRAP_HIGH  0xFFEE
 #define HD6301_VECTOR_TRAP_LOW   0xFFEF
 #define HD6301_VECTOR_SCI_HIGH   0xFFF0
@@ -125,17 +159,32 @@ typedef struct hd6301_s {
 #define HD6301_RAM_CTRL_RAME 6 /* RAM Enable */
 #define HD6301_RAM_CTRL_STBY 7 /* Standby Bit */
 
+typedef enum {
+  HD6301_CORE_TABLE,    /* Handler function table, supports tracing. */
+  HD6301_CORE_THREADED, /* Threaded code, with registers kept in locals. */
+} hd6301_core_t;
+
 void hd6301_trace_init(void);
 void hd6301_trace_dump(FILE *fh, int cpu_id);
+void hd6301_trace_enable(bool enable);
+bool hd6301_trace_enabled(void);
 
 void hd6301_dump(FILE *fh, hd6301_t *cpu);
 
 void hd6301_reset(hd6301_t *cpu, mem_t *mem, int id);
 void hd6301_execute(hd6301_t *cpu, mem_t *mem);
+void hd6301_core_select(hd6301_core_t core);
+void hd6301_jit_enable(bool enable);
+int hd6301_run(hd6301_t *cpu, mem_t *mem, int cycles);
+int hd6301_halted_cycles(hd6301_t *cpu, mem_t *mem);
 void hd6301_register_write(hd6301_t *cpu, mem_t *mem,
   uint16_t address, uint8_t value);
 void hd6301_register_read_notify(hd6301_t *cpu, mem_t *mem, uint16_t address);
 void hd6301_sci_receive(hd6301_t *cpu, mem_t *mem, uint8_t value);
+void hd6301_sci_transmitted(hd6301_t *cpu, mem_t *mem);
+void hd6301_p20_input(hd6301_t *cpu, mem_t *mem, bool level);
+void hd6301_pin_connect(hd6301_t *cpu, int port, uint8_t mask,
+  hd6301_pin_edge_t edge);
 void hd6301_irq(hd6301_t *cpu, mem_t *mem,
   uint16_t vector_low, uint16_t vector_high);
 
@@ -8,6 +8,10 @@
 #include <sys/time.h>
 #include <strings.h> /* strncasecmp() */
 #include <limits.h> /* PATH_MAX */
+#ifndef MCU_THREAD_DISABLE
+#include <pthread.h>
+#include <stdatomic.h>
+#endif /* MCU_THREAD_DISABLE */
 #ifdef WIN32
 #include <windows.h>
 #endif
@@ -23,6 +27,8 @@
 #include "crc32.h"
 #include "debugger.h"
 #include "panic.h"
+#include "event.h"
+#include "sci.h"
 
 
 
@@ -44,6 +50,15 @@
 
 #define SREC_LINE_MAX 128
 
+#define MCU_CLOCK_HZ 612900 /* HX-20 Clock Speed */
+#define BENCHMARK_CYCLES (MCU_CLOCK_HZ * 60) /* One emulated minute. */
+#define BENCHMARK_BOOT_CYCLES (MCU_CLOCK_HZ * 30) /* Give up on the menu. */
+#define MCU_QUANTUM_DEFAULT 64 /* Cycles the master may run ahead of slave. */
+#define MCU_QUANTUM_MAX UINT16_MAX /* Below one timer counter period. */
+#define MCU_HALTED_MAX 8192 /* Longest run while both MCUs are halted. */
+#define MCU_LINK_QUEUE_SIZE 256 /* Events in flight between MCU threads. */
+#define MCU_THREAD_SPIN 1000 /* Checks before a blocked MCU thread sleeps. */
+
 
 
 typedef enum {
@@ -55,12 +70,57 @@ typedef enum {
   AUTOLOAD_END,
 } autoload_t;
 
+#ifndef MCU_THREAD_DISABLE
+typedef enum {
+  MCU_LINK_SCI, /* Byte over the SCI. */
+  MCU_LINK_P34, /* Level of slave P34, wired to master P12. */
+} mcu_link_kind_t;
+
+typedef struct {
+  int64_t cycle; /* Clock of the sender when the receiver takes it. */
+  mcu_link_kind_t kind;
+  uint8_t value;
+} mcu_link_event_t;
+
+/* Lock-free queue with a single producer and a single consumer: */
+typedef struct {
+  mcu_link_event_t event[MCU_LINK_QUEUE_SIZE];
+  atomic_uint head;
+  atomic_uint tail;
+} mcu_link_queue_t;
+#endif /* MCU_THREAD_DISABLE */
+
 
 
 static hd6301_t master_mcu;
 static hd6301_t slave_mcu;
 static mem_t master_mem;
 static mem_t slave_mem;
+static int mcu_quantum = MCU_QUANTUM_DEFAULT;
+static int slave_owed = 0; /* Cycles the slave MCU is behind the master. */
+static event_queue_t slave_events; /* Peripherals on the slave clock. */
+static event_queue_t master_events; /* Serial and SCI on master clock. */
+static sci_channel_t sci_to_slave;
+static sci_channel_t sci_to_master;
+
+#ifndef MCU_THREAD_DISABLE
+static pthread_t mcu_thread;
+static pthread_mutex_t mcu_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mcu_thread_cond = PTHREAD_COND_INITIALIZER;
+static bool mcu_thread_started = false;
+static bool mcu_thread_active = false; /* Slave runs on its own thread. */
+static bool mcu_thread_parked = false;
+static atomic_bool mcu_thread_park_request = true;
+static atomic_bool mcu_thread_master_waiting = false;
+static atomic_bool mcu_thread_slave_waiting = false;
+static _Atomic int64_t mcu_thread_master_clock = 0;
+static _Atomic int64_t mcu_thread_slave_clock = 0;
+static atomic_bool mcu_thread_sci_to_slave = false; /* Master P22. */
+static mcu_link_queue_t master_to_slave;
+static mcu_link_queue_t slave_to_master;
+static mcu_link_queue_t slave_sci_to_master; /* Apart, stamped later. */
+static _Thread_local bool mcu_thread_is_slave = false;
+#endif /* MCU_THREAD_DISABLE */
 
 bool debugger_break = false;
 bool warp_mode = false;
@@ -170,6 +230,823 @@ static bool autoload_srec_line_from_file(FILE *fh, char *out_line)
 
 
 
+/* Run the slave peripherals that are due. Pin edges schedule those that
+   follow outputs, "all" is for when something else may have changed: */
+static void mcu_peripherals(bool all)
+{
+  int id;
+
+  /* The P21 output is set by the timer and not by a port write: */
+  if (rs232_saving() && master_mcu.p21_set) {
+    event_schedule(&slave_events, EVENT_RS232, slave_mcu.clock);
+  }
+
+  if (all) {
+    event_schedule(&slave_events, EVENT_RS232, slave_mcu.clock);
+    event_schedule(&slave_events, EVENT_PRINTER, slave_mcu.clock);
+    event_schedule(&slave_events, EVENT_CASSETTE, slave_mcu.clock);
+    event_schedule(&slave_events, EVENT_PIEZO, slave_mcu.clock);
+  }
+
+  while ((id = event_pop(&slave_events, slave_mcu.clock)) != -1) {
+    switch (id) {
+    case EVENT_RS232:
+      event_schedule(&slave_events, id,
+        rs232_execute(&master_mcu, &master_mem, &slave_mcu, &slave_mem));
+      break;
+
+    case EVENT_PRINTER:
+      event_schedule(&slave_events, id,
+        printer_execute(&slave_mcu, &slave_mem));
+      break;
+
+    case EVENT_CASSETTE:
+      event_schedule(&slave_events, id,
+        cassette_execute(&slave_mcu, &slave_mem));
+      break;
+
+#ifdef PIEZO_AUDIO_ENABLE
+    case EVENT_PIEZO:
+      event_schedule(&slave_events, id,
+        piezo_execute(&slave_mcu, &slave_mem));
+      break;
+#endif /* PIEZO_AUDIO_ENABLE */
+
+    default:
+      break;
+    }
+  }
+}
+
+
+
+/* Netlist of slave MCU outputs, called from within port writes: */
+
+static void mcu_p34_edge(hd6301_t *cpu, uint8_t value)
+{
+  (void)cpu;
+#ifndef MCU_THREAD_DISABLE
+  if (mcu_thread_is_slave) {
+    return; /* Sent over the link with the clock instead. */
+  }
+#endif /* MCU_THREAD_DISABLE */
+
+  /* Slave MCU P34 to master MCU P12: */
+  if (value & 0x10) {
+    master_mem.ram[HD6301_REG_PORT_1] |= 0x04;
+  } else {
+    master_mem.ram[HD6301_REG_PORT_1] &= ~0x04;
+  }
+}
+
+
+
+static void mcu_printer_edge(hd6301_t *cpu, uint8_t value)
+{
+  (void)value;
+  event_schedule(&slave_events, EVENT_PRINTER, cpu->clock);
+}
+
+
+
+static void mcu_cassette_edge(hd6301_t *cpu, uint8_t value)
+{
+  (void)value;
+  event_schedule(&slave_events, EVENT_CASSETTE, cpu->clock);
+}
+
+
+
+#ifdef PIEZO_AUDIO_ENABLE
+static void mcu_piezo_edge(hd6301_t *cpu, uint8_t value)
+{
+  (void)value;
+  event_schedule(&slave_events, EVENT_PIEZO, cpu->clock);
+}
+#endif /* PIEZO_AUDIO_ENABLE */
+
+
+
+static void mcu_netlist(bool printer)
+{
+  hd6301_pin_connect(&slave_mcu, 3, 0x10, mcu_p34_edge);
+  if (printer) {
+    hd6301_pin_connect(&slave_mcu, 1, 0x10, mcu_printer_edge); /* P14 */
+  }
+  hd6301_pin_connect(&slave_mcu, 3, 0x08, mcu_cassette_edge); /* P33 */
+#ifdef PIEZO_AUDIO_ENABLE
+  hd6301_pin_connect(&slave_mcu, 1, 0x20, mcu_piezo_edge); /* P15 */
+#endif /* PIEZO_AUDIO_ENABLE */
+
+  /* Edges only carry changes, so start from the present level: */
+  mcu_p34_edge(&slave_mcu, slave_mem.ram[HD6301_REG_PORT_3]);
+}
+
+
+
+/* Slave cycles until the next peripheral event, at least 1, up to "max": */
+static int mcu_slave_event_cycles(int max)
+{
+  uint64_t next;
+
+  next = event_next(&slave_events);
+  if (next == EVENT_NEVER || (int64_t)(next - slave_mcu.clock) >= max) {
+    return max;
+  }
+  if ((int64_t)(next - slave_mcu.clock) < 1) {
+    return 1;
+  }
+  return next - slave_mcu.clock;
+}
+
+
+
+/* Deliver the bytes and serial slots due on the master clock. SCI bytes
+   for the slave are due on the master clock too, which it has caught up: */
+static void mcu_master_events(void)
+{
+  int id;
+  int byte;
+
+  while ((id = event_pop(&master_events, master_mcu.clock)) != -1) {
+    switch (id) {
+    case EVENT_SCI_TO_MASTER:
+      byte = sci_channel_receive(&sci_to_master, master_mcu.clock);
+      if (byte >= 0) {
+        hd6301_sci_receive(&master_mcu, &master_mem, byte);
+      }
+      event_schedule(&master_events, id, sci_channel_next(&sci_to_master));
+      break;
+
+    case EVENT_SCI_TO_SLAVE:
+      byte = sci_channel_receive(&sci_to_slave, master_mcu.clock);
+      if (byte >= 0) {
+        hd6301_sci_receive(&slave_mcu, &slave_mem, byte);
+      }
+      event_schedule(&master_events, id, sci_channel_next(&sci_to_slave));
+      break;
+
+#ifndef SERIAL_DISABLE
+    case EVENT_SERIAL:
+      event_schedule(&master_events, id,
+        serial_execute(&master_mcu, &master_mem));
+      break;
+#endif /* SERIAL_DISABLE */
+
+    default:
+      break;
+    }
+  }
+}
+
+
+
+/* SCI from the master MCU has been redirected to external: */
+static void mcu_sci_external(void)
+{
+  if (master_mcu.transmit_shift_register < 0) {
+    return;
+  }
+
+#ifndef SERIAL_DISABLE
+  /* Transmits are passed on at once, the rest in byte slots: */
+  event_schedule(&master_events, EVENT_SERIAL, master_mcu.clock);
+#else
+  hd6301_sci_transmitted(&master_mcu, &master_mem); /* Nothing attached. */
+#endif /* SERIAL_DISABLE */
+}
+
+
+
+/* SCI transfer from slave MCU to master MCU, unless the FIFO is full: */
+static void mcu_slave_sci(void)
+{
+  if ((master_mem.ram[HD6301_REG_PORT_2] & 0x4) &&
+    slave_mcu.transmit_shift_register >= 0 &&
+    sci_channel_send(&sci_to_master, &slave_mem, slave_mcu.clock,
+    slave_mcu.transmit_shift_register) == 0) {
+    debugger_sci_trace_add(SCI_TRACE_DIR_SLAVE_TO_MASTER,
+      slave_mcu.transmit_shift_register, master_mcu.counter);
+    hd6301_sci_transmitted(&slave_mcu, &slave_mem);
+    event_schedule(&master_events, EVENT_SCI_TO_MASTER,
+      sci_channel_next(&sci_to_master));
+  }
+}
+
+
+
+static void mcu_interconnect(void)
+{
+  if (master_mem.ram[HD6301_REG_PORT_2] & 0x4) {
+    /* SCI transfer from master MCU to slave MCU, unless the FIFO is full: */
+    if (master_mcu.transmit_shift_register >= 0 &&
+      sci_channel_send(&sci_to_slave, &master_mem, master_mcu.clock,
+      master_mcu.transmit_shift_register) == 0) {
+      debugger_sci_trace_add(SCI_TRACE_DIR_MASTER_TO_SLAVE,
+        master_mcu.transmit_shift_register, master_mcu.counter);
+      hd6301_sci_transmitted(&master_mcu, &master_mem);
+      event_schedule(&master_events, EVENT_SCI_TO_SLAVE,
+        sci_channel_next(&sci_to_slave));
+    }
+
+    mcu_slave_sci();
+
+  } else {
+    mcu_sci_external();
+  }
+
+  mcu_master_events();
+}
+
+
+
+/* The master MCU runs for up to a quantum, ending early on outputs like SCI
+   transfers and port changes, then the slave MCU catches up. The slave ends
+   early on its own outputs too, which are serviced before it goes on: */
+static int mcu_run(int quantum)
+{
+  int elapsed;
+
+  elapsed = hd6301_run(&master_mcu, &master_mem, quantum);
+  slave_owed += elapsed;
+  while (slave_owed > 0) {
+    slave_owed -= hd6301_run(&slave_mcu, &slave_mem,
+      mcu_slave_event_cycles(slave_owed));
+    mcu_slave_sci();
+    mcu_peripherals(false);
+  }
+
+  mcu_interconnect();
+  return elapsed;
+}
+
+
+
+#ifndef MCU_THREAD_DISABLE
+static bool mcu_link_write(mcu_link_queue_t *queue, int64_t cycle,
+  mcu_link_kind_t kind, uint8_t value)
+{
+  unsigned int head;
+  mcu_link_event_t *event;
+
+  head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&queue->tail, memory_order_acquire)
+    == MCU_LINK_QUEUE_SIZE) {
+    return false; /* Full */
+  }
+
+  event = &queue->event[head % MCU_LINK_QUEUE_SIZE];
+  event->cycle = cycle;
+  event->kind = kind;
+  event->value = value;
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+  return true;
+}
+
+
+
+/* Only events sent at or before the clock of the receiver are taken: */
+static bool mcu_link_read(mcu_link_queue_t *queue, int64_t clock,
+  mcu_link_event_t *event)
+{
+  unsigned int tail;
+
+  tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+    return false; /* Empty */
+  }
+
+  if (queue->event[tail % MCU_LINK_QUEUE_SIZE].cycle > clock) {
+    return false; /* Not yet */
+  }
+
+  *event = queue->event[tail % MCU_LINK_QUEUE_SIZE];
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+  return true;
+}
+
+
+
+/* Clock of the next event for the receiver, or -1 if there is none: */
+static int64_t mcu_link_next(mcu_link_queue_t *queue)
+{
+  unsigned int tail;
+
+  tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+    return -1;
+  }
+  return queue->event[tail % MCU_LINK_QUEUE_SIZE].cycle;
+}
+
+
+
+/* Send the transmitted byte of the MCU, stamped with the clock when its
+   frame arrives. The channel only keeps the line timing here: */
+static bool mcu_link_sci(mcu_link_queue_t *queue, sci_channel_t *channel,
+  hd6301_t *cpu, mem_t *mem, int64_t clock)
+{
+  uint64_t due;
+
+  due = sci_channel_due(channel, mem, cpu->clock);
+  if (! mcu_link_write(queue, clock + (int64_t)(due - cpu->clock),
+    MCU_LINK_SCI, cpu->transmit_shift_register)) {
+    return false;
+  }
+  channel->line_free = due;
+  return true;
+}
+
+
+
+/* Deliver due events to the master, but at most one SCI byte at a time
+   like the shift register. Returns true if one was delivered: */
+static bool mcu_link_to_master(int64_t clock)
+{
+  mcu_link_event_t event;
+
+  while (mcu_link_read(&slave_to_master, clock, &event)) {
+    if (event.value) {
+      master_mem.ram[HD6301_REG_PORT_1] |= 0x04;
+    } else {
+      master_mem.ram[HD6301_REG_PORT_1] &= ~0x04;
+    }
+  }
+
+  if (mcu_link_read(&slave_sci_to_master, clock, &event)) {
+    debugger_sci_trace_add(SCI_TRACE_DIR_SLAVE_TO_MASTER,
+      event.value, master_mcu.counter);
+    hd6301_sci_receive(&master_mcu, &master_mem, event.value);
+    return true;
+  }
+  return false;
+}
+
+
+
+static bool mcu_link_to_slave(int64_t clock)
+{
+  mcu_link_event_t event;
+
+  if (mcu_link_read(&master_to_slave, clock, &event)) {
+    hd6301_sci_receive(&slave_mcu, &slave_mem, event.value);
+    return true;
+  }
+  return false;
+}
+
+
+
+/* Conservative time sync, wait until the other MCU clock is past floor: */
+static void mcu_thread_wait(_Atomic int64_t *other_clock, int64_t floor,
+  atomic_bool *waiting)
+{
+  int spin;
+
+  for (spin = 0; spin < MCU_THREAD_SPIN; spin++) {
+    if (atomic_load(other_clock) > floor ||
+      atomic_load(&mcu_thread_park_request)) {
+      return;
+    }
+  }
+
+  pthread_mutex_lock(&mcu_thread_mutex);
+  atomic_store(waiting, true);
+  while (atomic_load(other_clock) <= floor &&
+    ! atomic_load(&mcu_thread_park_request)) {
+    pthread_cond_wait(&mcu_thread_cond, &mcu_thread_mutex);
+  }
+  atomic_store(waiting, false);
+  pthread_mutex_unlock(&mcu_thread_mutex);
+}
+
+
+
+static void mcu_thread_notify(atomic_bool *waiting)
+{
+  if (atomic_load(waiting)) {
+    pthread_mutex_lock(&mcu_thread_mutex);
+    pthread_cond_broadcast(&mcu_thread_cond);
+    pthread_mutex_unlock(&mcu_thread_mutex);
+  }
+}
+
+
+
+static void *mcu_thread_slave(void *arg)
+{
+  int64_t clock;
+  int64_t next;
+  int cycles;
+  uint8_t p34 = 0;
+  (void)arg;
+
+  mcu_thread_is_slave = true;
+
+  while (1) {
+    if (atomic_load(&mcu_thread_park_request)) {
+      pthread_mutex_lock(&mcu_thread_mutex);
+      mcu_thread_parked = true;
+      pthread_cond_broadcast(&mcu_thread_cond);
+      while (atomic_load(&mcu_thread_park_request)) {
+        pthread_cond_wait(&mcu_thread_cond, &mcu_thread_mutex);
+      }
+      mcu_thread_parked = false;
+      pthread_mutex_unlock(&mcu_thread_mutex);
+      p34 = slave_mem.ram[HD6301_REG_PORT_3] & 0x10; /* Already wired. */
+      continue;
+    }
+
+    /* Stay within a quantum ahead of the master: */
+    clock = atomic_load(&mcu_thread_slave_clock);
+    mcu_thread_wait(&mcu_thread_master_clock, clock - mcu_quantum,
+      &mcu_thread_slave_waiting);
+    if (atomic_load(&mcu_thread_park_request)) {
+      continue;
+    }
+
+    cycles = atomic_load(&mcu_thread_master_clock) + mcu_quantum - clock;
+    if (cycles > mcu_quantum) {
+      cycles = mcu_quantum;
+    }
+    cycles = mcu_slave_event_cycles(cycles);
+    next = mcu_link_next(&master_to_slave);
+    if (next > clock && next - clock < cycles) {
+      cycles = next - clock;
+    }
+
+    clock += hd6301_run(&slave_mcu, &slave_mem, cycles);
+    atomic_store(&mcu_thread_slave_clock, clock);
+    mcu_thread_notify(&mcu_thread_master_waiting);
+
+    mcu_link_to_slave(clock);
+
+    if (atomic_load(&mcu_thread_sci_to_slave) &&
+      slave_mcu.transmit_shift_register >= 0) {
+      if (mcu_link_sci(&slave_sci_to_master, &sci_to_master,
+        &slave_mcu, &slave_mem, clock)) {
+        hd6301_sci_transmitted(&slave_mcu, &slave_mem);
+      }
+    }
+
+    if ((slave_mem.ram[HD6301_REG_PORT_3] & 0x10) != p34) {
+      if (mcu_link_write(&slave_to_master, clock, MCU_LINK_P34,
+        (slave_mem.ram[HD6301_REG_PORT_3] & 0x10) ? 1 : 0)) {
+        p34 = slave_mem.ram[HD6301_REG_PORT_3] & 0x10;
+      }
+    }
+
+    /* RS-232 is idle here, since transfers park this thread: */
+    mcu_peripherals(false);
+  }
+
+  return NULL;
+}
+
+
+
+static int mcu_thread_start(void)
+{
+  sigset_t set;
+  sigset_t old_set;
+  int result;
+
+  /* Signals are for the main thread only: */
+  sigfillset(&set);
+  pthread_sigmask(SIG_SETMASK, &set, &old_set);
+  result = pthread_create(&mcu_thread, NULL, mcu_thread_slave, NULL);
+  pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+  if (result != 0) {
+    return -1;
+  }
+
+  mcu_thread_started = true;
+  return 0;
+}
+
+
+
+/* Take the slave back to the main thread, for lockstep with RS-232 or the
+   debugger. Events in flight are delivered at once: */
+static void mcu_thread_park(void)
+{
+  if (! mcu_thread_active) {
+    return;
+  }
+
+  pthread_mutex_lock(&mcu_thread_mutex);
+  atomic_store(&mcu_thread_park_request, true);
+  pthread_cond_broadcast(&mcu_thread_cond);
+  while (! mcu_thread_parked) {
+    pthread_cond_wait(&mcu_thread_cond, &mcu_thread_mutex);
+  }
+  pthread_mutex_unlock(&mcu_thread_mutex);
+
+  while (mcu_link_to_master(INT64_MAX))
+    ;
+  while (mcu_link_to_slave(INT64_MAX))
+    ;
+
+  slave_owed = atomic_load(&mcu_thread_master_clock) -
+    atomic_load(&mcu_thread_slave_clock);
+  mcu_thread_active = false;
+}
+
+
+
+static void mcu_thread_unpark(void)
+{
+  int byte;
+
+  if (mcu_thread_active || ! mcu_thread_started) {
+    return;
+  }
+
+  /* The link takes over the SCI, so bytes on their way arrive at once: */
+  while ((byte = sci_channel_receive(&sci_to_master, EVENT_NEVER)) >= 0) {
+    hd6301_sci_receive(&master_mcu, &master_mem, byte);
+  }
+  while ((byte = sci_channel_receive(&sci_to_slave, EVENT_NEVER)) >= 0) {
+    hd6301_sci_receive(&slave_mcu, &slave_mem, byte);
+  }
+
+  atomic_store(&mcu_thread_master_clock, slave_owed);
+  atomic_store(&mcu_thread_slave_clock, 0);
+  atomic_store(&mcu_thread_sci_to_slave,
+    (master_mem.ram[HD6301_REG_PORT_2] & 0x4) ? true : false);
+
+  pthread_mutex_lock(&mcu_thread_mutex);
+  atomic_store(&mcu_thread_park_request, false);
+  pthread_cond_broadcast(&mcu_thread_cond);
+  pthread_mutex_unlock(&mcu_thread_mutex);
+  mcu_thread_active = true;
+}
+
+
+
+/* Master side of the split, the slave runs on its own thread meanwhile: */
+static int mcu_thread_master_run(void)
+{
+  int64_t clock;
+  int64_t next;
+  int cycles;
+  int elapsed;
+
+  /* Stay within a quantum ahead of the slave: */
+  clock = atomic_load(&mcu_thread_master_clock);
+  mcu_thread_wait(&mcu_thread_slave_clock, clock - mcu_quantum,
+    &mcu_thread_master_waiting);
+
+  cycles = atomic_load(&mcu_thread_slave_clock) + mcu_quantum - clock;
+  if (cycles > mcu_quantum) {
+    cycles = mcu_quantum;
+  }
+  next = mcu_link_next(&slave_to_master);
+  if (next > clock && next - clock < cycles) {
+    cycles = next - clock;
+  }
+  next = mcu_link_next(&slave_sci_to_master);
+  if (next > clock && next - clock < cycles) {
+    cycles = next - clock;
+  }
+
+  elapsed = hd6301_run(&master_mcu, &master_mem, cycles);
+  clock += elapsed;
+  atomic_store(&mcu_thread_master_clock, clock);
+  mcu_thread_notify(&mcu_thread_slave_waiting);
+
+  if (master_mem.ram[HD6301_REG_PORT_2] & 0x4) {
+    if (master_mcu.transmit_shift_register >= 0) {
+      if (mcu_link_sci(&master_to_slave, &sci_to_slave,
+        &master_mcu, &master_mem, clock)) {
+        debugger_sci_trace_add(SCI_TRACE_DIR_MASTER_TO_SLAVE,
+          master_mcu.transmit_shift_register, master_mcu.counter);
+        hd6301_sci_transmitted(&master_mcu, &master_mem);
+      }
+    }
+    atomic_store(&mcu_thread_sci_to_slave, true);
+  } else {
+    atomic_store(&mcu_thread_sci_to_slave, false);
+    mcu_sci_external();
+  }
+
+  mcu_master_events();
+  mcu_link_to_master(clock);
+  return elapsed;
+}
+#endif /* MCU_THREAD_DISABLE */
+
+
+
+/* While both MCUs are halted by SLP or WAI, they can be run up to the first
+   point where one may wake up by itself. That leaves little for the host to
+   do before it blocks on the timer: */
+static int mcu_halted_cycles(void)
+{
+  int master_cycles;
+  int slave_cycles;
+
+#ifndef SERIAL_DISABLE
+  if (serial_busy()) {
+    return 0; /* Input from the TTY is paced by the master cycles. */
+  }
+#endif /* SERIAL_DISABLE */
+
+  master_cycles = hd6301_halted_cycles(&master_mcu, &master_mem);
+  slave_cycles = hd6301_halted_cycles(&slave_mcu, &slave_mem);
+  if (master_cycles == 0 || slave_cycles == 0) {
+    return 0;
+  }
+
+  slave_cycles -= slave_owed; /* Wake up as seen from the master. */
+  if (slave_cycles < master_cycles) {
+    master_cycles = slave_cycles;
+  }
+  if (master_cycles > MCU_HALTED_MAX) {
+    master_cycles = MCU_HALTED_MAX;
+  }
+  return master_cycles;
+}
+
+
+
+/* Lower the quantum so the MCUs stop at the next peripheral event: */
+static int mcu_event_quantum(int quantum)
+{
+  uint64_t next;
+
+  next = event_next(&master_events);
+  if (next != EVENT_NEVER && (int64_t)(next - master_mcu.clock) < quantum) {
+    quantum = next - master_mcu.clock;
+  }
+
+  /* The slave also runs the cycles it owes: */
+  quantum = mcu_slave_event_cycles(quantum + slave_owed) - slave_owed;
+
+  if (quantum < 1) {
+    quantum = 1;
+  }
+  return quantum;
+}
+
+
+
+static double benchmark_time(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+
+
+static void benchmark_reset(mem_t *master_mem_initial,
+  mem_t *slave_mem_initial)
+{
+  master_mem = *master_mem_initial;
+  slave_mem = *slave_mem_initial;
+  hd6301_reset(&master_mcu, &master_mem, 0);
+  hd6301_reset(&slave_mcu, &slave_mem, 1);
+  mcu_p34_edge(&slave_mcu, slave_mem.ram[HD6301_REG_PORT_3]);
+  memset(&master_events, 0, sizeof(master_events));
+  memset(&slave_events, 0, sizeof(slave_events));
+  memset(&sci_to_slave, 0, sizeof(sci_to_slave));
+  memset(&sci_to_master, 0, sizeof(sci_to_master));
+  slave_owed = 0;
+}
+
+
+
+/* One step as in the main loop, failing if the slave MCU has been left more
+   than a quantum behind the master while it writes its ports: */
+static int benchmark_run(int quantum, unsigned long *cycles)
+{
+  *cycles += mcu_run(quantum);
+  if (slave_owed > quantum) {
+    fprintf(stdout, "Slave MCU %d cycles behind at quantum %d!\n",
+      slave_owed, quantum);
+    return -1;
+  }
+  return 0;
+}
+
+
+
+static int benchmark(void)
+{
+  static mem_t master_mem_initial;
+  static mem_t slave_mem_initial;
+  static const struct {
+    const char *name;
+    hd6301_core_t core;
+    bool traced;
+    bool jit;
+    int quantum; /* Cycles the master runs before the slave catches up. */
+    bool threads; /* Slave MCU on its own host thread. */
+  } runs[] = {
+    {"Table           ", HD6301_CORE_TABLE,    false, false, 1,  false},
+    {"Table (traced)  ", HD6301_CORE_TABLE,    true,  false, 1,  false},
+    {"Threaded        ", HD6301_CORE_THREADED, false, false, 1,  false},
+    {"Threaded (batch)", HD6301_CORE_THREADED, false, false, 64, false},
+    {"Threaded (JIT)  ", HD6301_CORE_THREADED, false, true,  64, false},
+#ifndef MCU_THREAD_DISABLE
+    {"Two host threads", HD6301_CORE_THREADED, false, true,  64, true},
+#endif /* MCU_THREAD_DISABLE */
+  };
+  static const int boot_quanta[] = {1, 8, 64, 512, 4096};
+  unsigned long instructions;
+  unsigned long cycles;
+  double start;
+  double seconds;
+
+  master_mem_initial = master_mem;
+  slave_mem_initial = slave_mem;
+  mcu_netlist(false);
+
+#ifndef MCU_THREAD_DISABLE
+  if (! mcu_thread_started) {
+    mcu_thread_start();
+  }
+#endif /* MCU_THREAD_DISABLE */
+
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    benchmark_reset(&master_mem_initial, &slave_mem_initial);
+    hd6301_core_select(runs[i].core);
+    hd6301_trace_enable(runs[i].traced);
+    hd6301_jit_enable(runs[i].jit);
+
+    cycles = 0;
+    start = benchmark_time();
+#ifndef MCU_THREAD_DISABLE
+    if (runs[i].threads && mcu_thread_started) {
+      mcu_quantum = runs[i].quantum;
+      mcu_thread_unpark();
+      while (cycles < BENCHMARK_CYCLES) {
+        cycles += mcu_thread_master_run();
+      }
+      mcu_thread_park();
+    }
+#endif /* MCU_THREAD_DISABLE */
+    while (cycles < BENCHMARK_CYCLES) {
+      if (benchmark_run(runs[i].quantum, &cycles) != 0) {
+        return -1;
+      }
+    }
+    seconds = benchmark_time() - start;
+
+    fprintf(stdout, "%s %lu cycles in %.2f seconds, %.1fx real time",
+      runs[i].name, cycles, seconds,
+      ((double)cycles / MCU_CLOCK_HZ) / seconds);
+    if (runs[i].core == HD6301_CORE_TABLE) {
+      /* Only the table core counts, both MCUs together: */
+      instructions = master_mcu.instructions + slave_mcu.instructions;
+      fprintf(stdout, ", %lu instructions, %.0f instructions/sec",
+        instructions, instructions / seconds);
+    }
+    fprintf(stdout, "\n");
+  }
+
+  /* Boot until the main menu takes a key from automatic key input. The
+     slave is held within a quantum, so any difference in cycles comes from
+     the coupling itself: */
+  hd6301_core_select(HD6301_CORE_THREADED);
+  hd6301_trace_enable(false);
+  hd6301_jit_enable(false);
+  for (size_t i = 0; i < sizeof(boot_quanta) / sizeof(boot_quanta[0]); i++) {
+    benchmark_reset(&master_mem_initial, &slave_mem_initial);
+    master_mem.ram[0x165] = 0xA; /* KYISFL */
+    master_mem.ram[0x166] = 2;   /* KYISCN */
+    master_mem.ram[0x16F] = '2'; /* KYISTK[0] */
+
+    cycles = 0;
+    start = benchmark_time();
+    while (cycles < BENCHMARK_BOOT_CYCLES && master_mem.ram[0x167] != 2) {
+      if (benchmark_run(boot_quanta[i], &cycles) != 0) {
+        return -1;
+      }
+    }
+    seconds = benchmark_time() - start;
+
+    if (master_mem.ram[0x167] != 2) {
+      fprintf(stdout, "Boot (quantum %4d) no menu after %lu cycles\n",
+        boot_quanta[i], cycles);
+    } else {
+      fprintf(stdout,
+        "Boot (quantum %4d) menu after %lu cycles in %.3f seconds\n",
+        boot_quanta[i], cycles, seconds);
+    }
+  }
+
+  hd6301_trace_enable(false);
+  hd6301_jit_enable(false);
+  return 0;
+}
+
+
+
 static void display_help(const char *progname)
 {
   fprintf(stdout, "Usage: %s <options> [file]\n", progname);
@@ -183,6 +1060,13 @@ static void display_help(const char *progname)
     "  -e         Activate extra 16K RAM expansion.\n"
     "  -o ROM     Load option ROM into address 0x6000.\n"
     "  -s         Load file as S-record into MONITOR.\n"
+    "  -B         Benchmark CPU emulation speed and exit.\n"
+    "  -C CORE    Use CORE for CPU emulation, 'table' or 'threaded'.\n"
+    "  -J         Translate hot ROM code into blocks. (Threaded core only.)\n"
+    "  -q CYCLES  Run each MCU for up to CYCLES before syncing. (Default %d.)\n"
+#ifndef MCU_THREAD_DISABLE
+    "  -T         Run the master and slave MCUs on separate host threads.\n"
+#endif /* MCU_THREAD_DISABLE */
     "  -p FILE    Enable micro-printer output to FILE.\n"
 #ifndef SERIAL_DISABLE
     "  -t TTY     Use TTY for external 38400 baud high speed serial.\n"
@@ -190,7 +1074,7 @@ static void display_help(const char *progname)
 #ifdef PIEZO_AUDIO_ENABLE
     "  -a         Disable piezo speaker audio.\n"
 #endif /* PIEZO_AUDIO_ENABLE */
-    "\n");
+    "\n", MCU_QUANTUM_DEFAULT);
   fprintf(stdout,
     "Specify a BASIC program text file to load it automatically.\n"
     "This happens by injecting the characters through auto key loading.\n"
@@ -214,6 +1098,7 @@ int main(int argc, char *argv[])
 {
   int c;
   char *charset_select = NULL;
+  char *core_select = NULL;
   FILE *autoload_fh = NULL;
   char *rom_directory = NULL;
   char *option_rom = NULL;
@@ -223,6 +1108,15 @@ int main(int argc, char *argv[])
 #endif /* SERIAL_DISABLE */
   bool ram_expansion = false;
   bool autoload_srec = false;
+  bool run_benchmark = false;
+  bool jit = false;
+#ifndef MCU_THREAD_DISABLE
+  bool mcu_threads = false;
+#endif /* MCU_THREAD_DISABLE */
+  int quantum;
+  int halted;
+  int elapsed;
+  uint64_t sleep_clock = 0;
 #ifdef PIEZO_AUDIO_ENABLE
   bool disable_audio = false;
 #endif /* PIEZO_AUDIO_ENABLE */
@@ -236,7 +1130,7 @@ int main(int argc, char *argv[])
   console_mode_t console_mode = CONSOLE_MODE_CURSES_PIXEL;
   console_charset_t console_charset = CONSOLE_CHARSET_US;
 
-  while ((c = getopt(argc, argv, "hbwaesm:c:r:o:p:t:")) != -1) {
+  while ((c = getopt(argc, argv, "hbwaesBJTm:c:C:q:r:o:p:t:")) != -1) {
     switch (c) {
     case 'h':
       display_help(argv[0]);
@@ -262,6 +1156,20 @@ int main(int argc, char *argv[])
       autoload_srec = true;
       break;
 
+    case 'B':
+      run_benchmark = true;
+      break;
+
+    case 'J':
+      jit = true;
+      break;
+
+    case 'T':
+#ifndef MCU_THREAD_DISABLE
+      mcu_threads = true;
+#endif /* MCU_THREAD_DISABLE */
+      break;
+
     case 'a':
 #ifdef PIEZO_AUDIO_ENABLE
       disable_audio = true;
@@ -272,6 +1180,18 @@ int main(int argc, char *argv[])
       charset_select = optarg;
       break;
 
+    case 'C':
+      core_select = optarg;
+      break;
+
+    case 'q':
+      mcu_quantum = atoi(optarg);
+      if (mcu_quantum < 1 || mcu_quantum > MCU_QUANTUM_MAX) {
+        fprintf(stdout, "Invalid MCU quantum: %s\n", optarg);
+        return EXIT_FAILURE;
+      }
+      break;
+
     case 'r':
       rom_directory = optarg;
       break;
@@ -331,6 +1251,18 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (core_select != NULL) {
+    if (strncasecmp(core_select, "table", 5) == 0) {
+      hd6301_core_select(HD6301_CORE_TABLE);
+    } else if (strncasecmp(core_select, "threaded", 8) == 0) {
+      hd6301_core_select(HD6301_CORE_THREADED);
+    } else {
+      fprintf(stdout, "Unknown CPU core: %s\n", core_select);
+      return EXIT_FAILURE;
+    }
+  }
+
+  hd6301_jit_enable(jit);
   hd6301_trace_init();
   debugger_init();
   signal(SIGINT, sig_handler);
@@ -385,6 +1317,13 @@ int main(int argc, char *argv[])
     }
   }
 
+  if (run_benchmark) {
+    if (benchmark() != 0) {
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
   if (printer_filename) {
     if (printer_init(printer_filename) != 0) {
       fprintf(stdout, "Printer initialization with output to '%s' failed!\n",
@@ -411,6 +1350,20 @@ int main(int argc, char *argv[])
   hd6301_reset(&master_mcu, &master_mem, 0);
   hd6301_reset(&slave_mcu, &slave_mem, 1);
 
+  /* Everything is due at first, to find out when it is next: */
+  event_schedule(&master_events, EVENT_SERIAL, master_mcu.clock);
+  mcu_netlist(printer_filename ? true : false);
+  mcu_peripherals(true);
+
+#ifndef MCU_THREAD_DISABLE
+  if (mcu_threads) {
+    if (mcu_thread_start() != 0) {
+      fprintf(stdout, "MCU thread creation failed!\n");
+      return EXIT_FAILURE;
+    }
+  }
+#endif /* MCU_THREAD_DISABLE */
+
   /* Setup timer to relax CPU: */
 #ifdef WIN32
   HANDLE timer = NULL;
@@ -455,48 +1408,31 @@ int main(int argc, char *argv[])
   }
 
   while (1) {
-    hd6301_execute(&master_mcu, &master_mem);
-    hd6301_execute(&slave_mcu, &slave_mem);
-
-    if (master_mem.ram[HD6301_REG_PORT_2] & 0x4) {
-      /* SCI transfer from master MCU to slave MCU: */
-      if (master_mcu.transmit_shift_register >= 0) {
-        debugger_sci_trace_add(SCI_TRACE_DIR_MASTER_TO_SLAVE,
-          master_mcu.transmit_shift_register, master_mcu.counter);
-        hd6301_sci_receive(&slave_mcu, &slave_mem,
-          master_mcu.transmit_shift_register);
-        master_mcu.transmit_shift_register = -1;
-      }
-
-      /* SCI transfer from slave MCU to master MCU: */
-      if (slave_mcu.transmit_shift_register >= 0) {
-        debugger_sci_trace_add(SCI_TRACE_DIR_SLAVE_TO_MASTER,
-          slave_mcu.transmit_shift_register, master_mcu.counter);
-        hd6301_sci_receive(&master_mcu, &master_mem,
-          slave_mcu.transmit_shift_register);
-        slave_mcu.transmit_shift_register = -1;
+#ifndef MCU_THREAD_DISABLE
+    /* RS-232 is wired to both MCUs, so it needs them on the same thread: */
+    if (mcu_threads) {
+      if (rs232_busy() || rs232_saving()) {
+        mcu_thread_park();
+      } else {
+        mcu_thread_unpark();
       }
-
-    } else {
-      /* SCI from master MCU has been redirected to external: */
-#ifndef SERIAL_DISABLE
-      serial_execute(&master_mcu, &master_mem);
-#endif /* SERIAL_DISABLE */
     }
 
-    rs232_execute(&master_mcu, &master_mem, &slave_mcu, &slave_mem);
-#ifdef PIEZO_AUDIO_ENABLE
-    piezo_execute(&slave_mcu, &slave_mem);
-#endif /* PIEZO_AUDIO_ENABLE */
-    console_execute(&master_mcu, &master_mem);
-    cassette_execute(&slave_mcu, &slave_mem);
-    printer_execute(&slave_mcu, &slave_mem);
-
-    /* Connect slave MCU P34 to master MCU P12: */
-    if (slave_mem.ram[HD6301_REG_PORT_3] & 0x10) {
-      master_mem.ram[HD6301_REG_PORT_1] |= 0x04;
-    } else {
-      master_mem.ram[HD6301_REG_PORT_1] &= ~0x04;
+    if (mcu_thread_active) {
+      /* The slave thread runs its own peripherals: */
+      elapsed = mcu_thread_master_run();
+      console_execute(&master_mcu, &master_mem, elapsed);
+    } else
+#endif /* MCU_THREAD_DISABLE */
+    {
+      quantum = mcu_quantum;
+      halted = mcu_halted_cycles();
+      if (halted > quantum) {
+        quantum = halted;
+      }
+      elapsed = mcu_run(mcu_event_quantum(quantum));
+      mcu_peripherals(false);
+      console_execute(&master_mcu, &master_mem, elapsed);
     }
 
     /* Handle automatic loading and key input: */
@@ -562,6 +1498,10 @@ int main(int argc, char *argv[])
 
     /* Debugger break?: */
     if (debugger_break) {
+#ifndef MCU_THREAD_DISABLE
+      mcu_thread_park();
+#endif /* MCU_THREAD_DISABLE */
+      mcu_peripherals(true); /* Files opened next start from here. */
       console_pause();
       if (panic_msg[0] != '\0') {
         fprintf(stdout, "%s", panic_msg);
@@ -572,12 +1512,13 @@ int main(int argc, char *argv[])
       if (! debugger_break) {
         console_resume();
       }
+      mcu_peripherals(true);
     }
 
     /* Sleep: */
     if (! warp_mode) {
-      if (master_mcu.sync_counter > 8192) {
-        master_mcu.sync_counter = 0;
+      if (master_mcu.clock - sleep_clock > 8192) {
+        sleep_clock = master_mcu.clock;
 #ifdef WIN32
         if (WaitForSingleObject(timer, INFINITE) != WAIT_OBJECT_0) {
           fprintf(stdout, "WaitForSingleObject() failed: %lu\n",
@@ -77,6 +77,63 @@ static uint8_t rtc_value(mem_t *mem, uint16_t address)
 
 
 
+/* Zero page with internal registers, master I/O and RTC: */
+static uint8_t mem_read_zero_page(mem_t *mem, uint16_t address)
+{
+  if (address < 0x20) {
+    hd6301_register_read_notify(mem->cpu, mem, address);
+  }
+  if (address >= MASTER_RTC_SECONDS && address <= MASTER_RTC_YEAR) {
+    return rtc_value(mem, address);
+
+  } else if (address == MASTER_IO_LCD_DATA) {
+    /* Accessing this address clocks the SCK signal to the LCD. */
+    console_lcd_clock();
+    ((hd6301_t *)mem->cpu)->sync_event = true;
+    return 0;
+
+  } else {
+    return mem->ram[address];
+  }
+}
+
+
+
+static void mem_write_zero_page(mem_t *mem, uint16_t address, uint8_t value)
+{
+  if (address < 0x20) {
+    hd6301_register_write(mem->cpu, mem, address, value);
+
+  } else if (address == MASTER_IO_PORT_26) { /* Special port at 0x26... */
+    mem->ram[MASTER_IO_PORT_26_FB] = value; /* ...is read back at 0x4F. */
+    console_lcd_select(value);
+
+  } else if (address == MASTER_IO_LCD_DATA) {
+    console_lcd_data(value);
+
+  } else if (address <= mem->ram_max) {
+    mem->ram[address] = value;
+
+  }
+
+  /* Let the console respond before the CPU continues: */
+  if (address >= 0x20 && address < MASTER_IO_END) {
+    ((hd6301_t *)mem->cpu)->sync_event = true;
+  }
+}
+
+
+
+/* Page with ROM, only the part up to "ram_max" can be written: */
+static void mem_write_rom_page(mem_t *mem, uint16_t address, uint8_t value)
+{
+  if (address <= mem->ram_max) {
+    mem->ram[address] = value;
+  }
+}
+
+
+
 void mem_init(mem_t *mem, void *cpu, uint16_t ram_max)
 {
   int i;
@@ -94,6 +151,18 @@ void mem_init(mem_t *mem, void *cpu, uint16_t ram_max)
     mem->ram[i] = 0xFF; /* ROM area. */
   }
 
+  for (i = 0; i < MEM_PAGES; i++) {
+    mem->generation[i] = 0;
+    mem->read_handler[i] = NULL;
+    if ((i * MEM_PAGE_SIZE) + (MEM_PAGE_SIZE - 1) <= mem->ram_max) {
+      mem->write_handler[i] = NULL;
+    } else {
+      mem->write_handler[i] = mem_write_rom_page;
+    }
+  }
+  mem->read_handler[0]  = mem_read_zero_page;
+  mem->write_handler[0] = mem_write_zero_page;
+
   mem->cpu = cpu;
 }
 
@@ -101,20 +170,13 @@ void mem_init(mem_t *mem, void *cpu, uint16_t ram_max)
 
 uint8_t mem_read(mem_t *mem, uint16_t address)
 {
-  if (address < 0x20) {
-    hd6301_register_read_notify(mem->cpu, mem, address);
-  }
-  if (address >= MASTER_RTC_SECONDS && address <= MASTER_RTC_YEAR) {
-    return rtc_value(mem, address);
+  mem_read_handler_t handler;
 
-  } else if (address == MASTER_IO_LCD_DATA) {
-    /* Accessing this address clocks the SCK signal to the LCD. */
-    console_lcd_clock();
-    return 0;
-
-  } else {
-    return mem->ram[address];
+  handler = mem->read_handler[address / MEM_PAGE_SIZE];
+  if (handler != NULL) {
+    return handler(mem, address);
   }
+  return mem->ram[address];
 }
 
 
@@ -130,20 +192,15 @@ void mem_read_area(mem_t *mem, uint16_t address, uint8_t data[], size_t size)
 
 void mem_write(mem_t *mem, uint16_t address, uint8_t value)
 {
-  if (address < 0x20) {
-    hd6301_register_write(mem->cpu, mem, address, value);
-
-  } else if (address == MASTER_IO_PORT_26) { /* Special port at 0x26... */
-    mem->ram[MASTER_IO_PORT_26_FB] = value; /* ...is read back at 0x4F. */
-    console_lcd_select(value);
-
-  } else if (address == MASTER_IO_LCD_DATA) {
-    console_lcd_data(value);
-
-  } else if (address <= mem->ram_max) {
-    mem->ram[address] = value;
+  mem_write_handler_t handler;
 
+  mem->generation[address / MEM_PAGE_SIZE]++;
+  handler = mem->write_handler[address / MEM_PAGE_SIZE];
+  if (handler != NULL) {
+    handler(mem, address, value);
+    return;
   }
+  mem->ram[address] = value;
 }
 
 
@@ -151,6 +208,7 @@ void mem_write(mem_t *mem, uint16_t address, uint8_t value)
 void mem_write_area(mem_t *mem, uint16_t address, uint8_t data[], size_t size)
 {
   for (uint16_t i = 0; i < size; i++) {
+    mem->generation[(uint16_t)(address + i) / MEM_PAGE_SIZE]++;
     mem->ram[address + i] = data[i];
   }
 }
@@ -168,6 +226,7 @@ int mem_load_from_file(mem_t *mem, const char *filename, uint16_t address)
   }
 
   while ((c = fgetc(fh)) != EOF) {
+    mem->generation[address / MEM_PAGE_SIZE]++;
     mem->ram[address] = c;
     address++; /* Just overflow... */
   }
@@ -8,12 +8,16 @@
 #define MEM_RAM_MAX_DEFAULT   0x3FFF /* Default 16K. */
 #define MEM_RAM_MAX_EXPANSION 0x7FFF /* 16K + 16K Expansion = 32K. */
 
+#define MEM_PAGE_SIZE 0x100
+#define MEM_PAGES     0x100
+
 #define MASTER_IO_KSC_GATE    0x0020 /* Keyboard Scan 0~7 */
 #define MASTER_IO_KRTN_GATE_A 0x0022 /* Keyboard Input 0~7 */
 #define MASTER_IO_PORT_26     0x0026 /* Special Port 26 */
 #define MASTER_IO_KRTN_GATE_B 0x0028 /* Keyboard Input 8, 9, PWSW & BUSY */
 #define MASTER_IO_LCD_DATA    0x002A /* Output Data to LCD Controller */
 #define MASTER_IO_PORT_26_FB  0x004F /* Special Port 26 Feedback */
+#define MASTER_IO_END         0x0050 /* External I/O and RTC below this. */
 
 #define MASTER_RTC_SECONDS       0x0040
 #define MASTER_RTC_SECONDS_ALARM 0x0041
@@ -30,10 +34,19 @@
 #define MASTER_RTC_REGISTER_C    0x004C
 #define MASTER_RTC_REGISTER_D    0x004D
 
+struct mem_s;
+typedef uint8_t (*mem_read_handler_t)(struct mem_s *mem, uint16_t address);
+typedef void (*mem_write_handler_t)(struct mem_s *mem, uint16_t address,
+  uint8_t value);
+
 typedef struct mem_s {
   uint8_t ram[UINT16_MAX + 1];
   void *cpu;
   uint16_t ram_max;
+  /* Page table, NULL handler means plain access to the page in "ram": */
+  mem_read_handler_t read_handler[MEM_PAGES];
+  mem_write_handler_t write_handler[MEM_PAGES];
+  uint64_t generation[MEM_PAGES]; /* Bumped on writes, for decoded code. */
 } mem_t;
 
 void mem_init(mem_t *mem, void *cpu, uint16_t ram_max);
@@ -7,6 +7,7 @@
 
 #include "hd6301.h"
 #include "mem.h"
+#include "event.h"
 
 #define AUDIO_SAMPLE_RATE 44100
 #define AUDIO_VOLUME 16 /* 0 -> 127 */
@@ -14,6 +15,7 @@
 #define PIEZO_SAMPLE_FACTOR 14 /* MCU cycles for each sample in sample rate. */
 #define PIEZO_FIFO_SIZE 32768 /* More than SDL sample size times factor. */
 #define PIEZO_OFF_TICK_COUNT 2000 /* Ticks until piezo should be silenced. */
+#define PIEZO_REFILL_CYCLES 1024 /* Cycles between FIFO refills. */
 
 
 
@@ -39,14 +41,15 @@ static int8_t piezo_fifo_read(void)
 
 
 
-static void piezo_fifo_write(int8_t sample)
+/* Same sample for many cycles, but no more than there is room for: */
+static void piezo_fifo_fill(int8_t sample, uint64_t count)
 {
-  if (((piezo_fifo_head + 1) % PIEZO_FIFO_SIZE) == piezo_fifo_tail) {
-    return; /* Full */
+  while (count > 0 &&
+    ((piezo_fifo_head + 1) % PIEZO_FIFO_SIZE) != piezo_fifo_tail) {
+    piezo_fifo[piezo_fifo_head] = sample;
+    piezo_fifo_head = (piezo_fifo_head + 1) % PIEZO_FIFO_SIZE;
+    count--;
   }
-
-  piezo_fifo[piezo_fifo_head] = sample;
-  piezo_fifo_head = (piezo_fifo_head + 1) % PIEZO_FIFO_SIZE;
 }
 
 
@@ -130,27 +133,35 @@ int piezo_init(void)
 
 
 
-void piezo_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
+/* Returns the slave clock cycle when the FIFO should be refilled. Also
+   called on slave outputs, so P15 has been the same since last time: */
+uint64_t piezo_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
 {
   static int off_ticks = PIEZO_OFF_TICK_COUNT;
-  static uint16_t sync_catchup = 0;
-
-  while (slave_mcu->sync_counter != sync_catchup) {
-    if (slave_mem->ram[HD6301_REG_PORT_1] & 0x20) {
-      piezo_fifo_write(1);
-      off_ticks = 0;
-
-    } else {
-      if (off_ticks >= PIEZO_OFF_TICK_COUNT) {
-        piezo_fifo_write(0);
-
-      } else {
-        piezo_fifo_write(-1);
-        off_ticks++;
-      }
+  static uint64_t sync_clock = 0;
+  static bool level = false;
+  uint64_t elapsed;
+  uint64_t ticks;
+
+  elapsed = slave_mcu->clock - sync_clock;
+  sync_clock = slave_mcu->clock;
+
+  if (level) {
+    piezo_fifo_fill(1, elapsed);
+    off_ticks = 0;
+
+  } else {
+    ticks = PIEZO_OFF_TICK_COUNT - off_ticks;
+    if (ticks > elapsed) {
+      ticks = elapsed;
     }
-    sync_catchup++;
+    piezo_fifo_fill(-1, ticks);
+    off_ticks += ticks;
+    piezo_fifo_fill(0, elapsed - ticks);
   }
+
+  level = slave_mem->ram[HD6301_REG_PORT_1] & 0x20;
+  return slave_mcu->clock + PIEZO_REFILL_CYCLES;
 }
 
 
@@ -5,6 +5,6 @@
 #include "mem.h"
 
 int piezo_init(void);
-void piezo_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
+uint64_t piezo_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
 
 #endif /* _PIEZO_H */
@@ -6,6 +6,7 @@
 
 #include "hd6301.h"
 #include "mem.h"
+#include "event.h"
 
 #define PULSE_TIMING 368 /* 600us / (1000000us / 612900Hz) */
 #define DOTS 144
@@ -39,69 +40,87 @@ int printer_init(const char *filename)
 
 
 
-void printer_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
+static void printer_pulse(mem_t *slave_mem)
 {
-  static uint16_t sync_catchup = 0;
+  /* Toggle timing signal (TS) input (P17) port. */
+  if (slave_mem->ram[HD6301_REG_PORT_1] & 0x80) {
+    slave_mem->ram[HD6301_REG_PORT_1] &= ~0x80;
+  } else {
+    slave_mem->ram[HD6301_REG_PORT_1] |= 0x80;
+  }
+
+  /* Set reset signal (RS) input (P16) port. */
+  if (head_pos < 72) {
+    slave_mem->ram[HD6301_REG_PORT_1] |= 0x40;
+  } else {
+    slave_mem->ram[HD6301_REG_PORT_1] &= ~0x40;
+  }
+
+  if (head_pos >= 2 && head_pos < (DOTS + 2)) {
+    if (slave_mem->ram[HD6301_REG_PORT_1] & 0x01) {
+      dot_line[((head_pos - 2) / 4) + 108] = '#';
+    } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x02) {
+      dot_line[((head_pos - 2) / 4) + 72]  = '#';
+    } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x04) {
+      dot_line[((head_pos - 2) / 4) + 36]  = '#';
+    } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x08) {
+      dot_line[((head_pos - 2) / 4)]       = '#';
+    }
+
+  } else if (head_pos == (DOTS + 2)) {
+    /* All dots printed, output to file. */
+    for (int i = 0; i < DOTS; i++) {
+      if (dot_line[i] != 0) {
+        fputc(dot_line[i], printer_output_fh);
+      } else {
+        fputc(' ', printer_output_fh);
+      }
+      dot_line[i] = 0;
+    }
+    fputc('\n', printer_output_fh);
+    fflush(printer_output_fh);
+  }
+
+  head_pos++;
+  if (head_pos >= 252) {
+    head_pos = 0;
+  }
+}
+
+
+
+/* Returns the slave clock cycle when the next pulse is due. Also called
+   on slave outputs, so the motor has been the same since last time: */
+uint64_t printer_execute(hd6301_t *slave_mcu, mem_t *slave_mem)
+{
+  static uint64_t sync_clock = 0;
   static uint16_t sync_counter = 0;
+  static bool motor_on = false;
+  uint64_t elapsed;
+
+  elapsed = slave_mcu->clock - sync_clock;
+  sync_clock = slave_mcu->clock;
 
   if (printer_output_fh == NULL) {
-    return;
+    return EVENT_NEVER;
   }
 
-  while (slave_mcu->sync_counter != sync_catchup) {
-    /* Check motor power output (P14) port. */
-    if ((slave_mem->ram[HD6301_REG_PORT_1] & 0x10) == 0) {
-      sync_counter++;
-      if (sync_counter > PULSE_TIMING) {
-        /* Toggle timing signal (TS) input (P17) port. */
-        if (slave_mem->ram[HD6301_REG_PORT_1] & 0x80) {
-          slave_mem->ram[HD6301_REG_PORT_1] &= ~0x80;
-        } else {
-          slave_mem->ram[HD6301_REG_PORT_1] |= 0x80;
-        }
-
-        /* Set reset signal (RS) input (P16) port. */
-        if (head_pos < 72) {
-          slave_mem->ram[HD6301_REG_PORT_1] |= 0x40;
-        } else {
-          slave_mem->ram[HD6301_REG_PORT_1] &= ~0x40;
-        }
-
-        if (head_pos >= 2 && head_pos < (DOTS + 2)) {
-          if (slave_mem->ram[HD6301_REG_PORT_1] & 0x01) {
-            dot_line[((head_pos - 2) / 4) + 108] = '#';
-          } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x02) {
-            dot_line[((head_pos - 2) / 4) + 72]  = '#';
-          } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x04) {
-            dot_line[((head_pos - 2) / 4) + 36]  = '#';
-          } else if (slave_mem->ram[HD6301_REG_PORT_1] & 0x08) {
-            dot_line[((head_pos - 2) / 4)]       = '#';
-          }
-
-        } else if (head_pos == (DOTS + 2)) {
-          /* All dots printed, output to file. */
-          for (int i = 0; i < DOTS; i++) {
-            if (dot_line[i] != 0) {
-              fputc(dot_line[i], printer_output_fh);
-            } else {
-              fputc(' ', printer_output_fh);
-            }
-            dot_line[i] = 0;
-          }
-          fputc('\n', printer_output_fh);
-          fflush(printer_output_fh);
-        }
-
-        head_pos++;
-        if (head_pos >= 252) {
-          head_pos = 0;
-        }
-        sync_counter = 0;
-      }
+  if (motor_on) {
+    /* A pulse is due each time the counter passes the timing: */
+    while (elapsed >= (uint64_t)(PULSE_TIMING + 1 - sync_counter)) {
+      elapsed -= PULSE_TIMING + 1 - sync_counter;
+      sync_counter = 0;
+      printer_pulse(slave_mem);
     }
+    sync_counter += elapsed;
+  }
 
-    sync_catchup++;
+  /* Check motor power output (P14) port. */
+  motor_on = (slave_mem->ram[HD6301_REG_PORT_1] & 0x10) == 0;
+  if (! motor_on) {
+    return EVENT_NEVER;
   }
+  return slave_mcu->clock + (PULSE_TIMING + 1 - sync_counter);
 }
 
 
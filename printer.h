@@ -5,6 +5,6 @@
 #include "mem.h"
 
 int printer_init(const char *filename);
-void printer_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
+uint64_t printer_execute(hd6301_t *slave_mcu, mem_t *slave_mem);
 
 #endif /* _PRINTER_H */
@@ -6,6 +6,9 @@
 #include "hd6301.h"
 #include "mem.h"
 #include "panic.h"
+#include "event.h"
+
+#define RS232_LOAD_BIT_CYCLES 513 /* Synchronized to 1200 baud. */
 
 
 
@@ -53,84 +56,49 @@ int rs232_save_file(const char *filename)
 
 
 
-void rs232_execute(hd6301_t *master_mcu, mem_t *master_mem,
-  hd6301_t *slave_mcu, mem_t *slave_mem)
+bool rs232_busy(void)
 {
-  static uint16_t sync_catchup = 0;
-  static uint16_t sync_counter = 0;
-  bool bit;
+  /* Loading drives the P20 input on its own timing: */
+  return rs232_load_fh != NULL;
+}
 
-  while (slave_mcu->sync_counter != sync_catchup) {
 
-    /* Saving */
 
-    if (rs232_save_fh != NULL) {
-      if (master_mcu->p21_set) {
-        if (master_mem->ram[HD6301_REG_PORT_2] & 0x02) {
-          bit = 1;
-        } else {
-          bit = 0;
-        }
+bool rs232_saving(void)
+{
+  return rs232_save_fh != NULL;
+}
 
-        switch (rs232_save_bit_state) {
-        case 0: /* Wait for Start Bit */
-          if (bit == 0) {
-            rs232_save_byte = 0;
-            rs232_save_bit_state++;
-          }
-          break;
-
-        case 1: /* Bits of Byte */
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-        case 6:
-        case 7:
-        case 8:
-          rs232_save_byte += bit << (rs232_save_bit_state - 1);
-          rs232_save_bit_state++;
-          break;
-
-        case 9: /* Stop Bit */
-          if (rs232_save_byte == 0x1A) { /* EOF */
-            fclose(rs232_save_fh);
-            rs232_save_fh = NULL;
-          } else {
-            fputc(rs232_save_byte, rs232_save_fh);
-          }
-          rs232_save_bit_state = 0;
-          break;
-        }
 
-        master_mcu->p21_set = false;
-      }
-    }
 
-    /* Loading */
+/* Returns the slave clock cycle when the next load bit is due: */
+uint64_t rs232_execute(hd6301_t *master_mcu, mem_t *master_mem,
+  hd6301_t *slave_mcu, mem_t *slave_mem)
+{
+  static uint64_t sync_clock = 0;
+  static uint16_t sync_counter = 0;
+  uint64_t elapsed;
+  bool bit;
 
-    if (rs232_load_fh == NULL) {
-      sync_catchup++;
-      sync_counter = 512; /* Always primed! */
-      continue;
-    }
+  elapsed = slave_mcu->clock - sync_clock;
+  sync_clock = slave_mcu->clock;
 
-    sync_counter++;
-    if (sync_counter > 512) { /* Synchronized to 1200 baud. */
-      sync_counter = 0;
+  /* Saving, P21 output is only looked at once it has changed: */
 
-      switch (rs232_load_bit_state) {
-      case -1: /* Init */
-        slave_mem->ram[HD6301_REG_PORT_2] |= 1;
-        break;
+  if (rs232_save_fh != NULL) {
+    if (master_mcu->p21_set) {
+      if (master_mem->ram[HD6301_REG_PORT_2] & 0x02) {
+        bit = 1;
+      } else {
+        bit = 0;
+      }
 
-      case 0: /* Start Bit */
-        rs232_load_byte = fgetc(rs232_load_fh);
-        if (rs232_load_byte == EOF) {
-          rs232_load_eof = true;
-          rs232_load_byte = 0x1A; /* EOF */
+      switch (rs232_save_bit_state) {
+      case 0: /* Wait for Start Bit */
+        if (bit == 0) {
+          rs232_save_byte = 0;
+          rs232_save_bit_state++;
         }
-        slave_mem->ram[HD6301_REG_PORT_2] &= ~1;
         break;
 
       case 1: /* Bits of Byte */
@@ -141,31 +109,83 @@ void rs232_execute(hd6301_t *master_mcu, mem_t *master_mem,
       case 6:
       case 7:
       case 8:
-        if ((rs232_load_byte >> (rs232_load_bit_state - 1)) & 1) {
-          slave_mem->ram[HD6301_REG_PORT_2] |= 1;
-        } else {
-          slave_mem->ram[HD6301_REG_PORT_2] &= ~1;
-        }
+        rs232_save_byte += bit << (rs232_save_bit_state - 1);
+        rs232_save_bit_state++;
         break;
 
       case 9: /* Stop Bit */
-      case 10: /* Idle Bit (Needed!) */
-        slave_mem->ram[HD6301_REG_PORT_2] |= 1;
+        if (rs232_save_byte == 0x1A) { /* EOF */
+          fclose(rs232_save_fh);
+          rs232_save_fh = NULL;
+        } else {
+          fputc(rs232_save_byte, rs232_save_fh);
+        }
+        rs232_save_bit_state = 0;
         break;
       }
 
-      rs232_load_bit_state++;
-      if (rs232_load_bit_state >= 11) {
-        rs232_load_bit_state = 0;
-        if (rs232_load_eof) {
-          fclose(rs232_load_fh);
-          rs232_load_fh = NULL;
-        }
+      master_mcu->p21_set = false;
+    }
+  }
+
+  /* Loading, each bit is due when the counter passes 512: */
+
+  while (rs232_load_fh != NULL &&
+    elapsed >= (uint64_t)(RS232_LOAD_BIT_CYCLES - sync_counter)) {
+    elapsed -= RS232_LOAD_BIT_CYCLES - sync_counter;
+    sync_counter = 0;
+
+    switch (rs232_load_bit_state) {
+    case -1: /* Init */
+      hd6301_p20_input(slave_mcu, slave_mem, true);
+      break;
+
+    case 0: /* Start Bit */
+      rs232_load_byte = fgetc(rs232_load_fh);
+      if (rs232_load_byte == EOF) {
+        rs232_load_eof = true;
+        rs232_load_byte = 0x1A; /* EOF */
+      }
+      hd6301_p20_input(slave_mcu, slave_mem, false);
+      break;
+
+    case 1: /* Bits of Byte */
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+    case 6:
+    case 7:
+    case 8:
+      if ((rs232_load_byte >> (rs232_load_bit_state - 1)) & 1) {
+        hd6301_p20_input(slave_mcu, slave_mem, true);
+      } else {
+        hd6301_p20_input(slave_mcu, slave_mem, false);
+      }
+      break;
+
+    case 9: /* Stop Bit */
+    case 10: /* Idle Bit (Needed!) */
+      hd6301_p20_input(slave_mcu, slave_mem, true);
+      break;
+    }
+
+    rs232_load_bit_state++;
+    if (rs232_load_bit_state >= 11) {
+      rs232_load_bit_state = 0;
+      if (rs232_load_eof) {
+        fclose(rs232_load_fh);
+        rs232_load_fh = NULL;
       }
     }
+  }
 
-    sync_catchup++;
+  if (rs232_load_fh == NULL) {
+    sync_counter = RS232_LOAD_BIT_CYCLES - 1; /* Always primed! */
+    return EVENT_NEVER;
   }
+  sync_counter += elapsed;
+  return slave_mcu->clock + (RS232_LOAD_BIT_CYCLES - sync_counter);
 }
 
 
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sci.h"
+#include "hd6301.h"
+#include "mem.h"
+#include "event.h"
+
+#define SCI_FRAME_BITS 10 /* Start bit, 8 data bits and stop bit. */
+
+
+
+/* Cycles per bit from the RMCR speed select. An external clock on P22 is
+   not emulated, so that also uses the speed select: */
+static uint64_t sci_bit_cycles(mem_t *mem)
+{
+  switch (mem->ram[HD6301_REG_RMCR] & 0x3) {
+  case 0:
+    return 16;
+  case 1:
+    return 128;
+  case 2:
+    return 1024;
+  default:
+    return 4096;
+  }
+}
+
+
+
+/* Clock when a byte sent now would arrive, after any frame on the line: */
+uint64_t sci_channel_due(sci_channel_t *channel, mem_t *mem, uint64_t clock)
+{
+  if (channel->line_free > clock) {
+    clock = channel->line_free;
+  }
+  return clock + (sci_bit_cycles(mem) * SCI_FRAME_BITS);
+}
+
+
+
+/* Returns -1 if the FIFO is full, then the byte should be sent again: */
+int sci_channel_send(sci_channel_t *channel, mem_t *mem, uint64_t clock,
+  uint8_t byte)
+{
+  if (channel->head - channel->tail == SCI_FIFO_SIZE) {
+    return -1;
+  }
+
+  channel->line_free = sci_channel_due(channel, mem, clock);
+  channel->due[channel->head % SCI_FIFO_SIZE] = channel->line_free;
+  channel->byte[channel->head % SCI_FIFO_SIZE] = byte;
+  channel->head++;
+  return 0;
+}
+
+
+
+/* Clock when the next byte is due, or EVENT_NEVER if there is none: */
+uint64_t sci_channel_next(sci_channel_t *channel)
+{
+  if (channel->head == channel->tail) {
+    return EVENT_NEVER;
+  }
+  return channel->due[channel->tail % SCI_FIFO_SIZE];
+}
+
+
+
+/* Returns the next byte if it is due by the clock, else -1: */
+int sci_channel_receive(sci_channel_t *channel, uint64_t clock)
+{
+  uint8_t byte;
+
+  if (channel->head == channel->tail ||
+    channel->due[channel->tail % SCI_FIFO_SIZE] > clock) {
+    return -1;
+  }
+
+  byte = channel->byte[channel->tail % SCI_FIFO_SIZE];
+  channel->tail++;
+  return byte;
+}
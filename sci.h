@@ -0,0 +1,26 @@
+#ifndef _SCI_H
+#define _SCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mem.h"
+
+#define SCI_FIFO_SIZE 4 /* Bytes on their way between the MCUs. */
+
+/* Bytes sent over the SCI, each due when its frame has been shifted out at
+   the rate of the sender. Starts out empty when zeroed: */
+typedef struct sci_channel_s {
+  uint64_t due[SCI_FIFO_SIZE];
+  uint8_t byte[SCI_FIFO_SIZE];
+  unsigned int head;
+  unsigned int tail;
+  uint64_t line_free; /* Clock of the sender when the last frame is done. */
+} sci_channel_t;
+
+uint64_t sci_channel_due(sci_channel_t *channel, mem_t *mem, uint64_t clock);
+int sci_channel_send(sci_channel_t *channel, mem_t *mem, uint64_t clock,
+  uint8_t byte);
+uint64_t sci_channel_next(sci_channel_t *channel);
+int sci_channel_receive(sci_channel_t *channel, uint64_t clock);
+
+#endif /* _SCI_H */
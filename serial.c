@@ -11,6 +11,7 @@
 #include "mem.h"
 #include "debugger.h"
 #include "panic.h"
+#include "event.h"
 
 #define SERIAL_RX_FIFO_SIZE 16384
 #define SERIAL_TX_FIFO_SIZE 1024
@@ -125,12 +126,25 @@ int serial_init(const char *tty_device)
 
 
 
-void serial_execute(hd6301_t *master_mcu, mem_t *master_mem)
+bool serial_busy(void)
 {
+  /* Received bytes are passed on at the baudrate: */
+  return serial_rx_fifo_head != serial_rx_fifo_tail;
+}
+
+
+
+/* Returns the master clock cycle of the next byte slot: */
+uint64_t serial_execute(hd6301_t *master_mcu, mem_t *master_mem)
+{
+  static uint64_t sync_last = 0;
   uint8_t byte;
 
   if (serial_tty_fd == -1) {
-    return;
+    if (master_mcu->transmit_shift_register >= 0) {
+      hd6301_sci_transmitted(master_mcu, master_mem); /* Nothing attached. */
+    }
+    return EVENT_NEVER;
   }
 
   if (master_mcu->transmit_shift_register >= 0) {
@@ -138,11 +152,12 @@ void serial_execute(hd6301_t *master_mcu, mem_t *master_mem)
     debugger_sci_trace_add(SCI_TRACE_DIR_MASTER_TO_EXT,
       master_mcu->transmit_shift_register, master_mcu->counter);
     serial_tx_fifo_write(master_mcu->transmit_shift_register);
-    master_mcu->transmit_shift_register = -1;
+    hd6301_sci_transmitted(master_mcu, master_mem);
   }
 
-  /* Sync to 8 bits with 38400 baudrate: */
-  if (master_mcu->sync_counter % 128 == 0) {
+  /* Sync to 8 bits with 38400 baudrate, also when run in batches: */
+  if (master_mcu->clock - sync_last >= 128) {
+    sync_last = master_mcu->clock;
     if (serial_rx_fifo_read(&byte)) {
       /* SCI transfer from external interface to master MCU: */
       debugger_sci_trace_add(SCI_TRACE_DIR_EXT_TO_MASTER,
@@ -154,12 +169,14 @@ void serial_execute(hd6301_t *master_mcu, mem_t *master_mem)
     if (serial_tx_fifo_read(&byte)) {
       write(serial_tty_fd, &byte, 1);
     }
-  }
 
-  /* Check if real TTY has data available: */
-  if (read(serial_tty_fd, &byte, 1) == 1) {
-    serial_rx_fifo_write(byte);
+    /* Check if real TTY has data available: */
+    if (read(serial_tty_fd, &byte, 1) == 1) {
+      serial_rx_fifo_write(byte);
+    }
   }
+
+  return sync_last + 128;
 }
 
 
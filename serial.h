@@ -5,6 +5,7 @@
 #include "mem.h"
 
 int serial_init(const char *tty_device);
-void serial_execute(hd6301_t *master_mcu, mem_t *master_mem);
+bool serial_busy(void);
+uint64_t serial_execute(hd6301_t *master_mcu, mem_t *master_mem);
 
 #endif /* _SERIAL_H */